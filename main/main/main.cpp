@@ -4,8 +4,35 @@
 #include <iostream>
 #include <stack>
 #include <unordered_set>
+#include <unordered_map>
 #include <cstdlib> // For rand()
 #include <ctime>   // For time()
+#include <cstdint>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <algorithm>
+#include <queue>
+#include <functional>
+#include <fstream>
+#include <cmath>
+#include <cstring>
+#include <cstdio>
+#include <mutex>
+#include <condition_variable>
+#include <limits>
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define MAZE_SSE2
+#endif
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h> // For GetProcessTimes() and the embedded resources
+#include "resource.h"
+#endif
+#include <SFML/OpenGL.hpp> // For glReadPixels() when capturing frames, after windows.h so NOMINMAX holds
 
 
 const int WIDTH = 800;
@@ -14,6 +41,39 @@ const int ROWS = 30;
 const int COLS = 40;
 const int BORDER_SIZE = 5;
 
+// Mazes whose cells would be smaller than MIN_CELL_SIZE pixels when fitted to the window scroll instead,
+// drawn at SCROLL_CELL_SIZE pixels per cell in square chunks of CHUNK_SIZE cells
+const float MIN_CELL_SIZE = 8.0f;
+const float SCROLL_CELL_SIZE = 24.0f;
+const int CHUNK_SIZE = 32;
+const size_t MAX_CACHED_CHUNKS = 256;
+
+// Zoomed out below LOD_CELL_SIZE pixels per cell, the scrolling maze is drawn from its image pyramid,
+// uploaded in square texture tiles of at most PYRAMID_TILE_SIZE pixels
+const float LOD_CELL_SIZE = 4.0f;
+const unsigned int PYRAMID_TILE_SIZE = 2048;
+
+// The minimap of a scrolling maze has at most MINIMAP_TEXELS texels a side, each covering a square block of
+// cells, and is drawn MINIMAP_SIZE pixels along its longer side
+const int MINIMAP_TEXELS = 256;
+const size_t MAX_FOG_CHANGES = 64; // Changed runs queued for the render thread before they are merged into one box
+const float MINIMAP_SIZE = 200.0f;
+
+// Maze and actor geometry is built in world units of one per cell, mapped to the window by an sf::View.
+// Walls are WALL_THICKNESS cells thick, one pixel at SCROLL_CELL_SIZE, but never thinner than one pixel of the
+// view they are drawn through (see getWallThickness), so they cannot drop out when zoomed or fitted small.
+const float WALL_THICKNESS = 1.0f / SCROLL_CELL_SIZE;
+
+// The game simulates at a fixed rate whatever the display runs at; the renderer interpolates between ticks
+const float TICK_SECONDS = 1.0f / 120;
+const int MAX_TICKS_PER_PASS = 8; // After a longer stall the backlog of ticks is dropped
+const float PLAYER_SPEED = 12.0f; // Cells per second
+
+// Row/column offsets for the wall directions: 0 = up, 1 = right, 2 = down, 3 = left
+const int DIR_ROW[4] = { -1, 0, 1, 0 };
+const int DIR_COL[4] = { 0, 1, 0, -1 };
+const uint8_t LAYOUT_CHECKPOINT = 0x10; // Set in a packed layout byte (see Maze::getLayout) on checkpoint cells
+
 // Struct to represent a cell in the maze
 struct Cell {
     int row, col;
@@ -27,33 +87,462 @@ struct Cell {
     }
 };
 
+// Struct to count what the render path sends through countedDraw: draw calls, vertices, and how often the
+// texture or shader changes from one draw to the next. The last texture and shader are kept across reset,
+// like the state cached by sf::RenderTarget.
+struct DrawCounters {
+    unsigned long drawCalls = 0;
+    unsigned long vertices = 0;
+    unsigned long textureSwitches = 0;
+    unsigned long shaderSwitches = 0;
+    const sf::Texture* texture = nullptr;
+    const sf::Shader* shader = nullptr;
+
+    void count(size_t vertexCount, const sf::Texture* drawTexture, const sf::Shader* drawShader);
+    void reset();
+    std::string describe() const;
+};
+
+// Counters for everything drawn since the last reset, read by the debug overlay and the render benchmark
+DrawCounters drawCounters;
+
+// Wrappers around sf::RenderTarget::draw that update drawCounters. Texts, sprites and shapes report the
+// texture they bind themselves.
+void countedDraw(sf::RenderTarget& target, const sf::VertexArray& vertices, const sf::RenderStates& states = sf::RenderStates::Default);
+void countedDraw(sf::RenderTarget& target, const sf::VertexBuffer& buffer, const sf::RenderStates& states = sf::RenderStates::Default);
+void countedDraw(sf::RenderTarget& target, const sf::VertexBuffer& buffer, size_t firstVertex, size_t vertexCount, const sf::RenderStates& states = sf::RenderStates::Default);
+void countedDraw(sf::RenderTarget& target, const sf::Vertex* vertices, size_t vertexCount, sf::PrimitiveType type, const sf::RenderStates& states = sf::RenderStates::Default);
+void countedDraw(sf::RenderTarget& target, const sf::Sprite& sprite, const sf::RenderStates& states = sf::RenderStates::Default);
+void countedDraw(sf::RenderTarget& target, const sf::Shape& shape, const sf::RenderStates& states = sf::RenderStates::Default);
+void countedDraw(sf::RenderTarget& target, const sf::Text& text, const sf::RenderStates& states = sf::RenderStates::Default);
+
+class Maze;
+
+// Sprites in the marker atlas
+enum MarkerSprite {
+    SPRITE_PLAYER,
+    SPRITE_CHECKPOINT,
+    SPRITE_EXIT,
+    SPRITE_COUNT
+};
+
+// Side in pixels of each sprite in the atlas
+const unsigned int ATLAS_CELL_SIZE = 64;
+
+// Class to draw every marker of a frame (the player, checkpoints and the exit) as quads of one vertex array
+// textured from a single atlas, so the whole layer is one draw call. Quads outside the view given to begin
+// are skipped. The atlas is painted in code, one ATLAS_CELL_SIZE square per sprite. A transform set after begin
+// places the sprites added next, such as those of one board among several.
+class SpriteLayer {
+public:
+    SpriteLayer() : vertices(sf::Quads) {}
+    void begin(const sf::RenderTarget& target);
+    void setTransform(const sf::Transform& placement) { transform = placement; }
+    void add(MarkerSprite sprite, sf::FloatRect area);
+    void addRound(MarkerSprite sprite, sf::Vector2f center, float radius);
+    void draw(sf::RenderTarget& target);
+
+private:
+    sf::Texture atlas;
+    bool atlasBuilt = false;
+    sf::VertexArray vertices;
+    sf::FloatRect visible;
+    sf::Vector2f pixelsPerUnit;
+    sf::Transform transform;
+
+    void buildAtlas();
+};
+
+// Class to hold an image pyramid of the maze for drawing it zoomed far out: level 0 has one pixel per cell,
+// each further level averages 2x2 pixels of the one below. Every level is uploaded as texture tiles and
+// level 0 is never kept in memory, its pixels are derived from the cells when needed.
+class MazePyramid {
+public:
+    void build(const Maze& maze);
+    void clear();
+    bool isBuilt() const { return !levels.empty(); }
+    void cellChanged(const Maze& maze, int index);
+    void draw(sf::RenderTarget& target, float pixelsPerCell);
+
+private:
+    struct Level {
+        int width = 0, height = 0;
+        int tilesPerRow = 0;
+        std::vector<sf::Uint8> pixels;
+        std::vector<sf::Texture> tiles;
+    };
+    std::vector<Level> levels;
+    unsigned int tileSize = PYRAMID_TILE_SIZE;
+
+    void texel(const Maze& maze, int level, int x, int y, sf::Uint8* out) const;
+    void average(const Maze& maze, int level, int x, int y);
+};
+
+// Ways Maze::draw can put the maze geometry on screen
+enum MazeRenderMode {
+    RENDER_BATCHED, // Vertex array submitted every frame
+    RENDER_CACHED,  // Vertex array rendered once into a render texture
+    RENDER_BUFFER,  // Vertex buffer kept in GPU memory
+    RENDER_SHADER   // One quad, walls decoded per pixel from a texture of cell bits
+};
+
+// Class to hold the BFS distance from the exit and from every checkpoint to each cell.
+// Distances are stored cell-major (all sources of one cell side by side) in 16-bit entries,
+// or 32-bit ones when the maze has too many cells for 16 bits.
+class DistanceFields {
+public:
+    static const uint32_t UNREACHABLE = 0xFFFFFFFF;
+
+    void build(const Maze& maze, const std::vector<int>& sources);
+    uint32_t get(int source, int index) const;
+
+private:
+    int sourceCount = 0;
+    bool wide = false;
+    std::vector<uint16_t> narrowDistances;
+    std::vector<uint32_t> wideDistances;
+
+    void set(int source, int index, uint32_t distance);
+};
+
 // Class to represent the maze
 class Maze {
 public:
-    Maze();
+    Maze(int rows = ROWS, int cols = COLS);
     void generate();
     void generateExit();
+    void load(const std::vector<uint8_t>& layout);
     void draw(sf::RenderWindow& window);
-    bool isWall(int row, int col, int dir);
+    void drawMarkers(SpriteLayer& sprites) const;
+    void appendWalls(sf::VertexArray& vertices, float thickness, const sf::IntRect& area) const;
+    void setRenderMode(MazeRenderMode mode);
+    void setScrolling(bool scrolling);
+    bool isScrolling() const;
+    sf::Vector2f getFittedCellSize(sf::Vector2u targetSize) const;
+    sf::View getView(const sf::RenderTarget& target, sf::Vector2f focus, float zoom) const;
+    bool isWall(int row, int col, int dir) const;
     bool isCheckpoint(int row, int col);
     void removeCheckpoint(int row, int col);
+    void setWall(int row, int col, int dir, bool wall);
+    void saveWalls(std::ostream& out) const;
+    std::vector<uint8_t> getLayout() const;
     const std::vector<Cell>& getCells() const;
     int getIndex(int row, int col) const;
+    int getRows() const;
+    int getCols() const;
+    int getExitIndex() const;
+    const std::vector<std::pair<int, int>>& getCheckpointPositions() const;
+    uint32_t distanceToExit(int row, int col) const;
+    uint32_t distanceToCheckpoint(int checkpoint, int row, int col) const;
 
 private:
+    int rows, cols;
     std::vector<Cell> cells;
+    std::vector<std::pair<int, int>> checkpointPositions;
+    // Built on the first distance query rather than per layout, so mazes that are never asked (the render
+    // thread's copy, spectator boards, dumps and benchmarks) never pay for them. Not safe to query from two
+    // threads before the first query returns.
+    mutable DistanceFields distances;
+    mutable bool distancesBuilt = false;
+
+    MazeRenderMode renderMode = RENDER_CACHED;
+
+    // Wall quads for the whole maze in world units, built once per layout and drawn in a
+    // single call. Every cell has a quad for each of its four walls, transparent while the wall is open, so
+    // toggling a wall only recolours vertices.
+    sf::VertexArray geometry;
+    bool geometryBuilt = false;
+    float wallThickness = WALL_THICKNESS; // Of the geometry and the chunks, for the view they were last drawn through
+    std::vector<size_t> cellVertices; // First vertex of each cell's quads, plus the total at the end
+
+    // The geometry rendered once offscreen at window resolution through the view covering layerArea; later
+    // changes only redraw the rectangle of the cell that changed
+    sf::RenderTexture layer;
+    sf::FloatRect layerArea;
+    bool layerValid = false;
+    std::vector<int> dirtyCells;
+
+    // The geometry uploaded once with static usage; changed cells are written back as sub-ranges
+    sf::VertexBuffer buffer;
+    bool bufferValid = false;
 
-    bool isValid(int row, int col);
+    // One texel per cell, red holding the wall bits
+    sf::Texture cellTexture;
+    sf::Shader wallShader;
+    bool shaderLoaded = false;
+    bool cellTextureValid = false;
+
+    // When scrolling, the closed walls are built per chunk of cells on first sight and only chunks in view are
+    // drawn; a chunk is rebuilt, not patched, when one of its walls changes
+    bool scrolling = false;
+    std::unordered_map<int, sf::VertexArray> chunks;
+    MazePyramid pyramid;
+
+    bool isValid(int row, int col) const;
     void connectNeighbors(Cell& current, Cell& neighbor);
+    void layoutChanged();
+    void buildDistances() const;
+    void buildGeometry();
+    void redrawCell(int index);
+    void cellChanged(int index);
+    bool drawCached(sf::RenderWindow& window);
+    bool drawBuffered(sf::RenderWindow& window);
+    bool drawShaded(sf::RenderWindow& window);
+    void cellTexel(int index, sf::Uint8* texel) const;
+    void appendCell(sf::VertexArray& vertices, int index, float x, float y, sf::Vector2f size) const;
+    int getChunk(int index) const;
+    void drawChunks(sf::RenderWindow& window);
+};
+
+// Class to search for paths through the open walls of a maze
+class Solver {
+public:
+    Solver(const Maze& maze) : maze(maze) {}
+    std::vector<int> bfs(int from, int to);
+    std::vector<int> bidirectionalBfs(int from, int to);
+    size_t getExplored() const { return explored; }
+
+private:
+    const Maze& maze;
+    size_t explored = 0;
+
+    int neighbor(int index, int dir) const;
+};
+
+// Class to show the shortest path from the player to the exit. The path is kept by D* Lite, searching
+// backwards from the exit, so player moves and wall changes only repair the cells whose distance changed.
+class PathHint {
+public:
+    PathHint(const Maze& maze) : maze(maze), geometry(sf::Quads) {}
+    void reset(int row, int col);
+    void moveStart(int row, int col);
+    void wallChanged(int row, int col, int dir);
+    void draw(sf::RenderWindow& window);
+    const std::vector<int>& getPath() const { return path; }
+
+private:
+    typedef std::pair<uint32_t, uint32_t> Key;
+    typedef std::pair<Key, int> Entry;
+
+    const Maze& maze;
+    int start = 0;
+    int last = 0;
+    int goal = 0;
+    uint32_t km = 0;
+    std::vector<uint32_t> g, rhs;
+    std::vector<Key> queuedKey;
+    std::vector<bool> queued;
+    std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> open;
+
+    std::vector<int> path; // From the exit back to the player, so moving along it only drops the tail
+    sf::VertexArray geometry;
+    size_t cleanQuads = 0; // Leading quads of geometry that still match path
+
+    uint32_t heuristic(int a, int b) const;
+    Key calculateKey(int cell) const;
+    void updateVertex(int cell);
+    void computeShortestPath();
+    void extractPath();
+    bool topKey(Key& key);
+};
+
+// Class to hide the cells the player has not seen. A cell sees along the open corridors of its row and of its
+// column, so what it sees is two runs of cells, stored as four reach lengths per cell worked out once per
+// layout by build. reveal ORs the two runs seen from a cell into the explored bitmask and queues each run that
+// added cells as its own changed rectangle. The mask is shared with the render thread, whose refresh copies only
+// those rectangles into the fog texture (one texel per cell, in tiles of PYRAMID_TILE_SIZE cells a side) and
+// the blocks they touch into the minimap texture. A fog that does not cover the maze only feeds the minimap.
+class FogOfWar {
+public:
+    explicit FogOfWar(bool covering) : covering(covering) {}
+    void build(const Maze& maze);
+    void reveal(int row, int col);
+    void refresh();
+    void draw(sf::RenderTarget& target);
+    void drawMinimap(sf::RenderTarget& target, sf::Vector2f player);
+
+private:
+    struct Sight {
+        uint16_t left, right, up, down; // Cells visible in a straight line each way, capped at 65535
+    };
+
+    std::vector<Sight> sight; // Game thread only
+
+    std::mutex mutex;
+    int rows = 0, cols = 0; // Guarded by mutex, as are the three below
+    std::vector<uint64_t> explored; // One bit per cell
+    std::vector<sf::IntRect> changed; // Runs of cells explored since the last refresh
+    unsigned long builds = 0;
+
+    // Render thread only
+    bool covering;
+    unsigned long drawnBuilds = 0;
+    sf::Vector2i drawnSize; // Columns and rows as of the last refresh
+    std::vector<sf::Texture> tiles;
+    int tilesPerRow = 0;
+    std::vector<sf::Uint8> texels;
+    std::vector<sf::IntRect> refreshing;
+    sf::Texture minimap; // One texel per block of minimapBlock cells a side, plus a last row holding the player colour
+    int minimapBlock = 1;
+    sf::VertexArray minimapQuads{ sf::Quads, 8 };
+
+    bool markRun(int first, int count, int stride);
+    bool isExplored(int row, int col) const;
+    void addChanged(const sf::IntRect& area);
+    void updateTextures(const sf::IntRect& area);
+};
+
+// Class to plan the shortest route from the start through every checkpoint to the exit. Pairwise distances
+// from the exit and the maze's own checkpoints are read from its distance fields, the others come from one
+// BFS per point spread over worker threads, then a Held-Karp DP over checkpoint subsets (2^n * n entries)
+// finds the best visiting order. Past MAX_TOUR_CHECKPOINTS the table would not fit in memory, so the order is
+// a nearest-neighbour walk instead, which is not necessarily the shortest.
+class TourPlanner {
+public:
+    TourPlanner(const Maze& maze) : maze(maze) {}
+    uint32_t plan(int start, const std::vector<int>& checkpoints, int exit);
+    const std::vector<int>& getOrder() const { return order; }
+
+private:
+    const Maze& maze;
+    std::vector<int> order; // Indices into the checkpoints passed to plan, in visiting order
+
+    std::vector<uint32_t> distancesFrom(int source, const std::vector<int>& targets) const;
+    uint32_t planGreedy(const std::vector<std::vector<uint32_t>>& distance, int n);
+};
+
+// Class to check a maze dump (see Maze::saveWalls) row by row without loading it. It keeps a small weighted
+// graph over the cells of the last row read: cells of earlier rows are contracted away as soon as they leave
+// the frontier (dead ends dropped, corridors merged into one edge), so memory stays proportional to the width.
+// Start is the top-left cell and the exit the bottom-right one, as in the game.
+class StreamSolver {
+public:
+    bool solve(std::istream& in);
+    bool isReachable() const { return reachable; }
+    uint64_t getPathLength() const { return pathLength; }
+    int getRows() const { return rows; }
+    int getCols() const { return cols; }
+    size_t getPeakNodes() const { return peakNodes; }
+
+private:
+    struct Node {
+        bool alive = false;
+        bool terminal = false;
+        std::vector<std::pair<int, uint64_t>> edges;
+    };
+
+    int rows = 0, cols = 0;
+    bool reachable = false;
+    uint64_t pathLength = 0;
+    size_t liveNodes = 0, peakNodes = 0;
+    std::vector<Node> nodes;
+    std::vector<int> freeNodes;
+    std::vector<int> pending;
+
+    int createNode();
+    void removeEdge(int from, int to);
+    void addEdge(int a, int b, uint64_t length);
+    void contract(int node);
+    uint64_t shortestDistance(int from, int to) const;
+};
+
+// Class to draw a maze into RGBA pixels on the CPU, with no window or GL context. The picture matches
+// Maze::draw and its exit and checkpoint sprites at a whole number of pixels per cell, with walls kept one
+// pixel wide. Given cellsPerPixel instead, each pixel is the average shade of a square of that many cells a
+// side, as in the zoomed-out image pyramid, for previews of mazes too large to draw cell by cell. Pixel rows
+// are produced in bands, so images can be written out without ever holding the whole picture.
+class SoftwareRasterizer {
+public:
+    SoftwareRasterizer(const Maze& maze, int cellSize, int cellsPerPixel = 0) : maze(maze), cellSize(cellSize), cellsPerPixel(cellsPerPixel) {}
+    int getWidth() const { return cellsPerPixel > 0 ? (maze.getCols() + cellsPerPixel - 1) / cellsPerPixel : maze.getCols() * cellSize + 1; }
+    int getHeight() const { return cellsPerPixel > 0 ? (maze.getRows() + cellsPerPixel - 1) / cellsPerPixel : maze.getRows() * cellSize + 1; }
+    void renderRows(int first, int count, uint32_t* pixels) const;
+    void render(std::vector<uint32_t>& pixels) const;
+    bool savePpm(const std::string& path) const;
+    bool savePng(const std::string& path) const;
+
+private:
+    const Maze& maze;
+    int cellSize;
+    int cellsPerPixel;
+
+    void renderReduced(int first, int count, uint32_t* pixels) const;
+};
+
+// Class to compress a byte stream to the zlib format: LZ77 over deflate's 32 KB window with hash chains, coded
+// with deflate's fixed Huffman tables in a single block. Input comes in pieces and the compressed bytes
+// completed so far are appended to out, so a PNG can be written band by band; matches do not reach back past
+// the start of the current piece. maxChain bounds the earlier positions tried for each match.
+class Deflater {
+public:
+    explicit Deflater(int maxChain);
+    void write(const uint8_t* data, size_t size, std::vector<uint8_t>& out);
+    void finish(std::vector<uint8_t>& out);
+
+private:
+    int maxChain;
+    std::vector<int32_t> head; // Latest position in the piece of each 3-byte hash, or -1
+    std::vector<int32_t> previous; // The position before it with the same hash, indexed by position in the window
+    uint64_t bits;
+    int bitCount;
+    uint32_t adlerA = 1, adlerB = 0;
+
+    void putBits(uint32_t value, int count, std::vector<uint8_t>& out);
+    void putCode(uint32_t code, int length, std::vector<uint8_t>& out);
+    void putSymbol(int symbol, std::vector<uint8_t>& out);
+    void putMatch(int length, int distance, std::vector<uint8_t>& out);
+};
+
+// Class to record the frames the game draws to a numbered PNG sequence. The render thread only reads the
+// framebuffer into one of a fixed pool of pixel buffers; a fixed pool of workers compresses and writes the files
+// and hands the buffers back, with a short match search so encoding keeps up with the frame rate.
+// When every buffer is in use the render thread waits rather than drop a frame, and those waits are counted as
+// back-pressure.
+class FrameCapture {
+public:
+    FrameCapture(const std::string& prefix, int workerCount, size_t bufferCount);
+    ~FrameCapture();
+    void capture(const sf::RenderWindow& window);
+
+private:
+    struct Frame {
+        std::vector<uint8_t> pixels;
+        unsigned int width = 0;
+        unsigned int height = 0;
+        unsigned long index = 0;
+    };
+
+    std::string prefix;
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable frameQueued;
+    std::condition_variable bufferFreed;
+    std::vector<std::unique_ptr<Frame>> freeFrames;
+    std::queue<std::unique_ptr<Frame>> queued;
+    bool stopping = false;
+
+    // Guarded by mutex
+    unsigned long frames = 0;
+    unsigned long stalls = 0;
+    double stallMs = 0;
+    size_t peakQueued = 0;
+    double encodeMs = 0;
+
+    void work();
 };
 
-// Class to represent the player
+// Class to represent the player. row and col are the cell the player is in or moving to; position is where it
+// is drawn, in cells, and slides to that cell one simulation tick at a time.
 class Player {
 public:
-    Player(int r, int c) : row(r), col(c) {}
+    Player(int r, int c);
     void move(int dx, int dy);
-    void draw(sf::RenderWindow& window);
+    void placeAt(int r, int c);
+    bool step(float distance);
+    bool isMoving() const;
+    void draw(SpriteLayer& sprites) const;
     int row, col;
+    sf::Vector2f position;
 };
 
 // Class to represent a button
@@ -75,8 +564,8 @@ public:
     Button() {}
 
     void draw(sf::RenderWindow& window) {
-        window.draw(m_rect);
-        window.draw(m_text);
+        countedDraw(window, m_rect);
+        countedDraw(window, m_text);
     }
 
     bool isClicked(const sf::Vector2f& mousePos) {
@@ -90,16 +579,35 @@ public:
     float m_height;
 };
 
+// Class to load each font and texture once and share it by handle. Assets registered with embed are
+// loaded from memory; anything else is read from disk on first request.
+class Resources {
+public:
+    size_t loadFont(const std::string& name);
+    size_t loadTexture(const std::string& name);
+    sf::Font& getFont(size_t handle);
+    sf::Texture& getTexture(size_t handle);
+    void embed(const std::string& name, const void* data, size_t size);
+
+private:
+    // Held by pointer so references stay valid as more resources are loaded
+    std::vector<std::unique_ptr<sf::Font>> fonts;
+    std::vector<std::unique_ptr<sf::Texture>> textures;
+    std::unordered_map<std::string, size_t> fontHandles;
+    std::unordered_map<std::string, size_t> textureHandles;
+    std::unordered_map<std::string, std::pair<const void*, size_t>> embedded;
+};
+
 // Class to represent the menu
 class Menu {
 public:
-    Menu();
+    Menu(sf::Font& font);
     void draw(sf::RenderWindow& window);
     int handleInput(sf::RenderWindow& window);
     sf::Font& getFont();
 private:
     sf::Text title;
-    sf::Font font;
+    sf::Font& font;
     Button startButton;
     Button exitButton;
 };
@@ -116,6 +624,172 @@ private:
     std::string answer;
 };
 
+// Class to draw a checkpoint question over the game. The question is word-wrapped to the window once per
+// question and window size, and typing only rebuilds the answer line.
+class QuestionOverlay {
+public:
+    QuestionOverlay(const sf::Font& font) : font(font) {}
+    void setQuestion(const std::string& question);
+    void setAnswer(const std::string& answer);
+    void draw(sf::RenderWindow& window);
+
+private:
+    const sf::Font& font;
+    sf::String question;
+    sf::Vector2u layoutSize;
+    sf::RectangleShape box;
+    sf::Text questionText;
+    sf::Text answerText;
+
+    void layout(sf::Vector2u windowSize);
+    sf::String wrap(const sf::String& text, unsigned int characterSize, float maxWidth) const;
+};
+
+// Phases of one frame timed by FrameProfiler
+enum FramePhase {
+    PHASE_EVENTS,   // pollEvent on the game thread
+    PHASE_UPDATE,   // Handling events on the game thread and applying the snapshot on the render thread
+    PHASE_MAZE,     // window.clear and Maze::draw
+    PHASE_SPRITES,  // The sprite layer: player, checkpoints and exit
+    PHASE_OVERLAYS, // Hint, menu, win text and this HUD
+    PHASE_DISPLAY,  // Frame capture and window.display, including vsync waits
+    PHASE_COUNT
+};
+
+// Frames kept by FrameProfiler, also the width in pixels of its graph
+const int FRAME_HISTORY = 600;
+
+// Class to time the phases of each frame. The last FRAME_HISTORY frames are kept for percentiles, a
+// stacked frame-time graph and CSV export.
+class FrameProfiler {
+public:
+    FrameProfiler();
+    void beginFrame();
+    void begin(FramePhase phase);
+    void add(FramePhase phase, float milliseconds);
+    void endFrame();
+    float percentile(int phase, float fraction) const;
+    float maximum(int phase) const;
+    bool exportCsv(const std::string& path) const;
+    void draw(sf::RenderWindow& window, const sf::Font& font) const;
+
+private:
+    sf::Clock clock;
+    sf::Int64 phaseStart;
+    int phase;
+    float current[PHASE_COUNT];
+    std::vector<float> history; // FRAME_HISTORY rows of PHASE_COUNT milliseconds
+    int next;
+    int frames;
+
+    float frameTime(int frame, int phase) const;
+};
+
+// Class to hand the newest value from one producer thread to one consumer thread without locks. The producer
+// fills the back slot and swaps it with the middle one; the consumer swaps the middle slot with its front
+// slot when a newer value is waiting there. Neither side ever waits for the other.
+template <typename T>
+class TripleBuffer {
+public:
+    T& back() { return slots[backIndex]; }
+    const T& front() const { return slots[frontIndex]; }
+
+    void publish() {
+        backIndex = middle.exchange(backIndex | FRESH) & ~FRESH;
+    }
+
+    // Returns whether a newer value was taken
+    bool update() {
+        if (!(middle.load() & FRESH)) return false;
+        frontIndex = middle.exchange(frontIndex) & ~FRESH;
+        return true;
+    }
+
+private:
+    static const int FRESH = 4; // Set on the middle index while it holds a value the consumer has not taken
+    T slots[3];
+    std::atomic<int> middle{ 1 };
+    int frontIndex = 0;
+    int backIndex = 2;
+};
+
+// Struct to hold everything the render thread draws a frame from. The game loop publishes a new one after each
+// batch of events; it is a value, so the render thread never reads the game's own state.
+struct GameSnapshot {
+    std::shared_ptr<const std::vector<uint8_t>> layout; // The maze as generated (see Maze::getLayout), null until the game starts
+    std::vector<int> checkpoints; // Cells that still hold a checkpoint
+    int playerRow = 0;
+    int playerCol = 0;
+    sf::Vector2f previousPosition; // Player position at the tick before tickTime, in cells
+    sf::Vector2f position; // Player position at tickTime
+    sf::Time tickTime; // Game clock time of the latest tick
+    bool gameStarted = false;
+    bool gameWon = false;
+    bool showHint = false;
+    bool showProfiler = false;
+    float zoom = 1.0f;
+    bool questionActive = false;
+    std::string question;
+    std::string answer;
+    unsigned long csvRequests = 0; // F4 presses so far
+    double eventMs = 0; // Time the game loop has spent polling events so far
+    double updateMs = 0; // Time the game loop has spent handling them so far
+};
+
+// Class to draw the game on its own thread, which holds the window's GL context. It keeps its own copy of the
+// maze, player, hint, menu and overlays and brings them up to date from the newest snapshot before each frame.
+// The player is drawn between its positions at the last two ticks, by how far the game clock has moved
+// past the latest one. Unless continuous, it sleeps until a snapshot is published while nothing moves.
+class GameRenderer {
+public:
+    GameRenderer(sf::RenderWindow& window, sf::Font& font, int rows, int cols);
+    ~GameRenderer();
+    Maze& getMaze() { return maze; }
+    void setCapture(std::unique_ptr<FrameCapture> frameCapture) { capture = std::move(frameCapture); }
+    void setFog(std::shared_ptr<FogOfWar> fogOfWar) { fog = std::move(fogOfWar); }
+    void start(bool continuous, const sf::Clock& gameClock);
+    void stop();
+    void publish(GameSnapshot snapshot);
+    unsigned long getFrames() const { return frames; }
+
+private:
+    sf::RenderWindow& window;
+    const sf::Font& font;
+    Menu menu;
+    Maze maze;
+    Player player;
+    PathHint hint;
+    SpriteLayer sprites;
+    QuestionOverlay questionOverlay;
+    FrameProfiler profiler;
+    DrawCounters lastFrameDraws;
+    std::unique_ptr<FrameCapture> capture;
+    std::shared_ptr<FogOfWar> fog; // Shared with the game loop, which reveals cells in it
+
+    TripleBuffer<GameSnapshot> snapshots;
+    std::thread thread;
+    std::atomic<bool> running{ false };
+    std::atomic<unsigned long> frames{ 0 };
+    bool continuous = false;
+    const sf::Clock* gameClock = nullptr;
+    std::mutex wakeMutex;
+    std::condition_variable wake;
+    bool published = true; // Guarded by wakeMutex; true at first so the menu is drawn straight away
+
+    // What has been applied from snapshots so far
+    std::shared_ptr<const std::vector<uint8_t>> layout;
+    bool hintShown = false;
+    std::string question;
+    std::string answer;
+    unsigned long csvRequests = 0;
+    double eventMs = 0;
+    double updateMs = 0;
+
+    void run();
+    void apply(const GameSnapshot& snapshot);
+    void drawFrame(const GameSnapshot& snapshot);
+};
+
 // Global list of questions
 std::vector<Question> questions = {
     Question("What is the definition of green / sustainable energy in comparison with renewable or clean energy ?\n\n 1. Sustainable energy includes any energy sourcewith little or no GHG emissions, that cannot be depleted and can remain viable forever; in comparison renewable energy,is exhaustible it uses resources from the earth that can naturally be replenished, but determine less GHG emissions, and clean energy exhaustible, but without GHG emissions\n 2. All these energy sources are without or with less GHG emissions, but Green / sustainable energy is exhaustible; by comparison Renewable energy sources and Clean energy sources are notexhaustible.\n 3. All these energy sources harm the environment by GHG emissions, but Green/ sustainable energy represents any energy so urce that cannot be depleted; in comparison Renewable energy can be depleted with natural system of regeneration, and Clean energy are exhaustible.\n 4. All these energy sources produce less or no GHG emissions, but Green / sustainable energy can be depleted, by comparison with the other two energy sources that can remain for ever.\n\n Choose the correct answer/s by leaving an empty space in between:  ", "1"),
@@ -127,183 +801,2921 @@ std::vector<Question> questions = {
     Question("What is the definition of green hydrogen?\n\n 1. Green hydrogen is the hydrogen produced by the electrolysis of water, using electricity generated from any source of energy.\n 2. Green hydrogen is the hydrogen accumulated in natural reservoirs under the Earth mantel.\n 3. Green hydrogen is hydrogen produced by the electrolysis of water , using electricity generated only from renewable sources.\n 4. Green hydrogen is the hydrogen produced by the electrolysis of water, and theCO2 emissions due to the use of electricity generated with fossil fuels are subject to underground storage.\n\n Choose the correct answer/s by leaving an empty space in between: ", "3")
 };
 
+// Class to show many mazes at once in a grid, each with a player walking its shortest route to the exit and
+// starting over. The walls of every board go once into one static vertex buffer and each board is drawn as its
+// range of it under the board's transform. The exit and checkpoint sprites are laid out once too, so the only
+// geometry rebuilt per frame is the players' sprite layer.
+class SpectatorGrid {
+public:
+    SpectatorGrid(int boardCount, int rows, int cols);
+    void tick();
+    void draw(sf::RenderTarget& target, float alpha);
+
+private:
+    struct Board {
+        std::unique_ptr<Maze> maze;
+        std::vector<int> route;
+        size_t step = 0;
+        float speed = 0; // Cells per second
+        Player player = Player(0, 0);
+        sf::Vector2f previousPosition;
+        sf::Transform transform;
+        size_t firstVertex = 0;
+        size_t vertexCount = 0;
+    };
+
+    int rows, cols;
+    int gridRows, gridCols;
+    std::vector<Board> boards;
+
+    // Built for one target size, so walls stay at least a pixel wide however small the boards are drawn
+    sf::Vector2u builtFor;
+    sf::VertexArray walls; // Only kept when vertex buffers are not available
+    sf::VertexBuffer wallBuffer;
+    bool useBuffer = false;
+    SpriteLayer markers;
+    SpriteLayer players;
+
+    sf::View getView() const;
+    void build(const sf::RenderTarget& target);
+};
+
 sf::Font& Menu::getFont() {
     return font;
 }
 
-Maze::Maze() {
-    for (int i = 0; i < ROWS; ++i) {
-        for (int j = 0; j < COLS; ++j) {
-            cells.push_back(Cell(i, j));
-        }
-    }
-}
+size_t Resources::loadFont(const std::string& name) {
+    auto found = fontHandles.find(name);
+    if (found != fontHandles.end()) return found->second;
 
-void Maze::generateExit() {
-    int side = rand() % 4;
-    int cellIndex;
-    switch (side) {
-    case 0: cellIndex = rand() % COLS; connectNeighbors(cells[cellIndex], cells[cellIndex + COLS]); break;
-    case 1: cellIndex = COLS * (ROWS - 1) + (rand() % COLS); connectNeighbors(cells[cellIndex], cells[cellIndex + 1]); break;
-    case 2: cellIndex = COLS * (ROWS - 1) + (rand() % COLS); connectNeighbors(cells[cellIndex], cells[cellIndex - COLS]); break;
-    case 3: cellIndex = rand() % COLS; connectNeighbors(cells[cellIndex], cells[cellIndex - 1]); break;
+    fonts.emplace_back(new sf::Font());
+    auto blob = embedded.find(name);
+    bool loaded = blob != embedded.end()
+        ? fonts.back()->loadFromMemory(blob->second.first, blob->second.second)
+        : fonts.back()->loadFromFile(name);
+    if (!loaded) {
+        std::cerr << "Error loading font " << name << "\n";
     }
+    return fontHandles[name] = fonts.size() - 1;
 }
 
-void Maze::generate() {
-    std::stack<Cell*> stack;
-    Cell* current = &cells[0];
-    current->visited = true;
-
-    while (true) {
-        std::vector<Cell*> unvisitedNeighbors;
-        for (int i = 0; i < 4; ++i) {
-            int next_row = current->row + (i == 0 ? -1 : (i == 2 ? 1 : 0));
-            int next_col = current->col + (i == 1 ? 1 : (i == 3 ? -1 : 0));
-            if (isValid(next_row, next_col) && !cells[getIndex(next_row, next_col)].visited) {
-                unvisitedNeighbors.push_back(&cells[getIndex(next_row, next_col)]);
-            }
-        }
+size_t Resources::loadTexture(const std::string& name) {
+    auto found = textureHandles.find(name);
+    if (found != textureHandles.end()) return found->second;
 
-        if (!unvisitedNeighbors.empty()) {
-            Cell* next = unvisitedNeighbors[rand() % unvisitedNeighbors.size()];
-            connectNeighbors(*current, *next);
-            stack.push(current);
-            current = next;
-            current->visited = true;
-        }
-        else if (!stack.empty()) {
-            current = stack.top();
-            stack.pop();
-        }
-        else {
-            break;
-        }
+    textures.emplace_back(new sf::Texture());
+    auto blob = embedded.find(name);
+    bool loaded = blob != embedded.end()
+        ? textures.back()->loadFromMemory(blob->second.first, blob->second.second)
+        : textures.back()->loadFromFile(name);
+    if (!loaded) {
+        std::cerr << "Error loading texture " << name << "\n";
     }
+    return textureHandles[name] = textures.size() - 1;
+}
 
-    generateExit();
-
-    std::vector<std::pair<int, int>> checkpointPositions = { {8,22}, {13,15}, {7,0}, {15,7}, {29,11}, {21,39}, {22,27} };
-    for (const auto& pos : checkpointPositions) {
-        int row = pos.first;
-        int col = pos.second;
-        cells[getIndex(row, col)].checkpoint = true;
-    }
+sf::Font& Resources::getFont(size_t handle) {
+    return *fonts[handle];
 }
 
-void Maze::draw(sf::RenderWindow& window) {
-    // Calculate the cell size based on the window dimensions and number of rows/columns
-    float cellSizeX = static_cast<float>(window.getSize().x - 2 * BORDER_SIZE) / COLS;
-    float cellSizeY = static_cast<float>(window.getSize().y - 2 * BORDER_SIZE) / ROWS;
+sf::Texture& Resources::getTexture(size_t handle) {
+    return *textures[handle];
+}
 
-    for (int i = 0; i < cells.size(); ++i) {
-        int x = cells[i].col * cellSizeX + BORDER_SIZE;
-        int y = cells[i].row * cellSizeY + BORDER_SIZE;
-
-        for (int j = 0; j < 4; ++j) {
-            if (cells[i].walls[j]) {
-                sf::RectangleShape wall;
-                switch (j) {
-                case 0: wall.setSize(sf::Vector2f(cellSizeX, 1)); wall.setPosition(x, y); break;
-                case 1: wall.setSize(sf::Vector2f(1, cellSizeY)); wall.setPosition(x + cellSizeX, y); break;
-                case 2: wall.setSize(sf::Vector2f(cellSizeX, 1)); wall.setPosition(x, y + cellSizeY); break;
-                case 3: wall.setSize(sf::Vector2f(1, cellSizeY)); wall.setPosition(x, y); break;
-                }
-                wall.setFillColor(sf::Color::White);
-                window.draw(wall);
-            }
-        }
+// The data must outlive the resources loaded from it; sf::Font reads from it lazily
+void Resources::embed(const std::string& name, const void* data, size_t size) {
+    embedded[name] = std::make_pair(data, size);
+}
 
-        if (cells[i].row == ROWS - 1 && cells[i].col == COLS - 1) {
-            sf::RectangleShape exit;
-            exit.setSize(sf::Vector2f(cellSizeX, cellSizeY));
-            exit.setPosition(x, y);
-            exit.setFillColor(sf::Color::Red); // Set exit cell color to red
-            window.draw(exit);
-        }
+// Registers the assets compiled into the executable (see main.rc); other builds read them from disk
+void embedCompiledAssets(Resources& resources) {
+#ifdef _WIN32
+    HRSRC info = FindResource(NULL, MAKEINTRESOURCE(IDR_ARIAL_FONT), RT_RCDATA);
+    HGLOBAL data = info ? LoadResource(NULL, info) : NULL;
+    if (data) {
+        resources.embed("Arial.ttf", LockResource(data), SizeofResource(NULL, info));
+    }
+#else
+    (void)resources;
+#endif
+}
 
-        if (cells[i].checkpoint) {
-            sf::RectangleShape checkpoint(sf::Vector2f(cellSizeX, cellSizeY));
-            checkpoint.setPosition(x, y);
-            checkpoint.setFillColor(sf::Color::Yellow);
-            window.draw(checkpoint);
-        }
+void DrawCounters::count(size_t vertexCount, const sf::Texture* drawTexture, const sf::Shader* drawShader) {
+    ++drawCalls;
+    vertices += vertexCount;
+    if (drawTexture != texture) {
+        ++textureSwitches;
+        texture = drawTexture;
+    }
+    if (drawShader != shader) {
+        ++shaderSwitches;
+        shader = drawShader;
     }
 }
 
+void DrawCounters::reset() {
+    drawCalls = vertices = textureSwitches = shaderSwitches = 0;
+}
 
-bool Maze::isWall(int row, int col, int dir) {
-    if (!isValid(row, col)) return true;
-    return cells[getIndex(row, col)].walls[dir];
+std::string DrawCounters::describe() const {
+    return std::to_string(drawCalls) + " draw calls, " + std::to_string(vertices) + " vertices, "
+        + std::to_string(textureSwitches) + " texture switches, " + std::to_string(shaderSwitches) + " shader switches";
 }
 
-bool Maze::isCheckpoint(int row, int col) {
-    return cells[getIndex(row, col)].checkpoint;
+void countedDraw(sf::RenderTarget& target, const sf::VertexArray& vertices, const sf::RenderStates& states) {
+    drawCounters.count(vertices.getVertexCount(), states.texture, states.shader);
+    target.draw(vertices, states);
 }
 
-void Maze::removeCheckpoint(int row, int col) {
-    cells[getIndex(row, col)].checkpoint = false;
+void countedDraw(sf::RenderTarget& target, const sf::VertexBuffer& buffer, const sf::RenderStates& states) {
+    drawCounters.count(buffer.getVertexCount(), states.texture, states.shader);
+    target.draw(buffer, states);
 }
 
-const std::vector<Cell>& Maze::getCells() const {
-    return cells;
+void countedDraw(sf::RenderTarget& target, const sf::VertexBuffer& buffer, size_t firstVertex, size_t vertexCount, const sf::RenderStates& states) {
+    drawCounters.count(vertexCount, states.texture, states.shader);
+    target.draw(buffer, firstVertex, vertexCount, states);
 }
 
-int Maze::getIndex(int row, int col) const {
-    return row * COLS + col;
+void countedDraw(sf::RenderTarget& target, const sf::Vertex* vertices, size_t vertexCount, sf::PrimitiveType type, const sf::RenderStates& states) {
+    drawCounters.count(vertexCount, states.texture, states.shader);
+    target.draw(vertices, vertexCount, type, states);
 }
 
-bool Maze::isValid(int row, int col) {
-    return row >= 0 && row < ROWS && col >= 0 && col < COLS;
+void countedDraw(sf::RenderTarget& target, const sf::Sprite& sprite, const sf::RenderStates& states) {
+    drawCounters.count(4, sprite.getTexture(), states.shader);
+    target.draw(sprite, states);
 }
 
-void Maze::connectNeighbors(Cell& current, Cell& neighbor) {
-    int dx = neighbor.col - current.col;
-    int dy = neighbor.row - current.row;
+// A shape is a triangle fan for the fill and, with an outline, a second triangle strip drawn untextured
+void countedDraw(sf::RenderTarget& target, const sf::Shape& shape, const sf::RenderStates& states) {
+    drawCounters.count(shape.getPointCount() + 2, shape.getTexture(), states.shader);
+    if (shape.getOutlineThickness() != 0) {
+        drawCounters.count((shape.getPointCount() + 1) * 2, nullptr, states.shader);
+    }
+    target.draw(shape, states);
+}
 
-    if (dx == 1) {
-        current.walls[1] = false;
-        neighbor.walls[3] = false;
+// A text is two triangles per visible glyph, plus as many again for an outline
+void countedDraw(sf::RenderTarget& target, const sf::Text& text, const sf::RenderStates& states) {
+    size_t glyphs = 0;
+    const sf::String& string = text.getString();
+    for (size_t i = 0; i < string.getSize(); ++i) {
+        if (string[i] != ' ' && string[i] != '\n' && string[i] != '\t') {
+            ++glyphs;
+        }
     }
-    else if (dx == -1) {
-        current.walls[3] = false;
-        neighbor.walls[1] = false;
+    const sf::Texture* glyphTexture = text.getFont() ? &text.getFont()->getTexture(text.getCharacterSize()) : nullptr;
+    if (text.getOutlineThickness() != 0) {
+        drawCounters.count(glyphs * 6, glyphTexture, states.shader);
     }
-    else if (dy == 1) {
-        current.walls[2] = false;
-        neighbor.walls[0] = false;
+    drawCounters.count(glyphs * 6, glyphTexture, states.shader);
+    target.draw(text, states);
+}
+
+// Paints the sprites: the player as an antialiased disc, checkpoints and the exit as solid squares
+void SpriteLayer::buildAtlas() {
+    const unsigned int size = ATLAS_CELL_SIZE;
+    sf::Image image;
+    image.create(size * SPRITE_COUNT, size, sf::Color::Transparent);
+
+    const int samples = 4;
+    float radius = size / 2.0f - 1;
+    for (unsigned int y = 0; y < size; ++y) {
+        for (unsigned int x = 0; x < size; ++x) {
+            int inside = 0;
+            for (int sy = 0; sy < samples; ++sy) {
+                for (int sx = 0; sx < samples; ++sx) {
+                    float dx = x + (sx + 0.5f) / samples - size / 2.0f;
+                    float dy = y + (sy + 0.5f) / samples - size / 2.0f;
+                    if (dx * dx + dy * dy <= radius * radius) ++inside;
+                }
+            }
+            image.setPixel(SPRITE_PLAYER * size + x, y, sf::Color(0, 255, 0, static_cast<sf::Uint8>(255 * inside / (samples * samples))));
+            image.setPixel(SPRITE_CHECKPOINT * size + x, y, sf::Color::Yellow);
+            image.setPixel(SPRITE_EXIT * size + x, y, sf::Color::Red);
+        }
     }
-    else if (dy == -1) {
-        current.walls[0] = false;
-        neighbor.walls[2] = false;
+
+    if (!atlas.loadFromImage(image)) {
+        std::cerr << "Error creating sprite atlas\n";
     }
+    atlas.setSmooth(true);
+    atlasBuilt = true;
 }
 
-void Player::move(int dx, int dy) {
-    row += dy;
-    col += dx;
+// Starts a frame's sprites for the target's current view
+void SpriteLayer::begin(const sf::RenderTarget& target) {
+    if (!atlasBuilt) {
+        buildAtlas();
+    }
+    vertices.clear();
+    transform = sf::Transform::Identity;
+    const sf::View& view = target.getView();
+    visible = sf::FloatRect(view.getCenter() - view.getSize() / 2.0f, view.getSize());
+    pixelsPerUnit = sf::Vector2f(target.getSize().x / view.getSize().x, target.getSize().y / view.getSize().y);
 }
 
-void Player::draw(sf::RenderWindow& window) {
-    float cellSizeX = static_cast<float>(window.getSize().x - 2 * BORDER_SIZE) / COLS;
-    float cellSizeY = static_cast<float>(window.getSize().y - 2 * BORDER_SIZE) / ROWS;
-    float radius = std::min(cellSizeX, cellSizeY) / 3;
+// Texture coordinates are inset by half a texel, so smoothing never samples the neighbouring sprite
+void SpriteLayer::add(MarkerSprite sprite, sf::FloatRect area) {
+    area = transform.transformRect(area);
+    if (!area.intersects(visible)) return;
+    float left = sprite * static_cast<float>(ATLAS_CELL_SIZE) + 0.5f;
+    float right = (sprite + 1) * static_cast<float>(ATLAS_CELL_SIZE) - 0.5f;
+    float top = 0.5f;
+    float bottom = ATLAS_CELL_SIZE - 0.5f;
+    vertices.append(sf::Vertex(sf::Vector2f(area.left, area.top), sf::Vector2f(left, top)));
+    vertices.append(sf::Vertex(sf::Vector2f(area.left + area.width, area.top), sf::Vector2f(right, top)));
+    vertices.append(sf::Vertex(sf::Vector2f(area.left + area.width, area.top + area.height), sf::Vector2f(right, bottom)));
+    vertices.append(sf::Vertex(sf::Vector2f(area.left, area.top + area.height), sf::Vector2f(left, bottom)));
+}
 
-    sf::CircleShape circle(radius);
-    circle.setFillColor(sf::Color::Green);
-    circle.setPosition(col * cellSizeX + BORDER_SIZE + cellSizeX / 2 - radius, row * cellSizeY + BORDER_SIZE + cellSizeY / 2 - radius);
+// Adds a sprite that stays round where the view stretches one axis more than the other; radius is in units
+// of the less stretched axis
+void SpriteLayer::addRound(MarkerSprite sprite, sf::Vector2f center, float radius) {
+    float pixels = std::min(pixelsPerUnit.x, pixelsPerUnit.y);
+    sf::Vector2f half(radius * pixels / pixelsPerUnit.x, radius * pixels / pixelsPerUnit.y);
+    add(sprite, sf::FloatRect(center - half, half * 2.0f));
+}
 
-    window.draw(circle);
+void SpriteLayer::draw(sf::RenderTarget& target) {
+    if (vertices.getVertexCount() == 0) return;
+    countedDraw(target, vertices, sf::RenderStates(&atlas));
 }
 
-Menu::Menu() {
-    sf::VideoMode desktop = sf::VideoMode::getDesktopMode();
-    if (!font.loadFromFile("arial.ttf")) {
-        std::cerr << "Error loading font\n";
-    }
+// Wall thickness in world units for the target's current view: WALL_THICKNESS, or one pixel if that is wider
+float getWallThickness(const sf::RenderTarget& target) {
+    const sf::View& view = target.getView();
+    return std::max(WALL_THICKNESS, std::max(view.getSize().x / target.getSize().x, view.getSize().y / target.getSize().y));
+}
 
-    float buttonWidth = desktop.width / 4;
-    float buttonHeight = desktop.height / 12;
+// Appends an axis-aligned rectangle to a vertex array of quads
+void appendQuad(sf::VertexArray& vertices, float x, float y, float width, float height, sf::Color color) {
+    vertices.append(sf::Vertex(sf::Vector2f(x, y), color));
+    vertices.append(sf::Vertex(sf::Vector2f(x + width, y), color));
+    vertices.append(sf::Vertex(sf::Vector2f(x + width, y + height), color));
+    vertices.append(sf::Vertex(sf::Vector2f(x, y + height), color));
+}
+
+void QuestionOverlay::setQuestion(const std::string& text) {
+    question = text;
+    layoutSize = sf::Vector2u();
+    answerText.setString("");
+}
+
+void QuestionOverlay::setAnswer(const std::string& answer) {
+    answerText.setString(answer);
+}
+
+// Breaks lines at spaces so none is wider than maxWidth; a single word that is too long is split anywhere
+sf::String QuestionOverlay::wrap(const sf::String& text, unsigned int characterSize, float maxWidth) const {
+    sf::String wrapped;
+    float lineWidth = 0;
+    size_t lineStart = 0;  // Position in wrapped where the current line begins
+    size_t lastSpace = sf::String::InvalidPos;
+    for (size_t i = 0; i < text.getSize(); ++i) {
+        sf::Uint32 c = text[i];
+        if (c == '\n') {
+            wrapped += c;
+            lineWidth = 0;
+            lineStart = wrapped.getSize();
+            lastSpace = sf::String::InvalidPos;
+            continue;
+        }
+
+        float advance = font.getGlyph(c, characterSize, false).advance;
+        if (lineWidth + advance > maxWidth && wrapped.getSize() > lineStart) {
+            if (lastSpace != sf::String::InvalidPos) {
+                // Turn the last space into a line break and carry the partial word over
+                wrapped[lastSpace] = '\n';
+                lineStart = lastSpace + 1;
+                lastSpace = sf::String::InvalidPos;
+            }
+            else {
+                wrapped += '\n';
+                lineStart = wrapped.getSize();
+            }
+            lineWidth = 0;
+            for (size_t j = lineStart; j < wrapped.getSize(); ++j) {
+                lineWidth += font.getGlyph(wrapped[j], characterSize, false).advance;
+            }
+        }
+
+        if (c == ' ') {
+            lastSpace = wrapped.getSize();
+        }
+        wrapped += c;
+        lineWidth += advance;
+    }
+    return wrapped;
+}
+
+void QuestionOverlay::layout(sf::Vector2u windowSize) {
+    box.setSize(sf::Vector2f(windowSize.x, windowSize.y));
+    box.setFillColor(sf::Color(0, 0, 0, 200)); // Semi-transparent black
+
+    // Adjust font size dynamically based on window dimensions
+    unsigned int fontSize = std::min(windowSize.x / 40, windowSize.y / 30);
+    float padding = 20.0f;
+    float maxTextWidth = windowSize.x - 2 * padding;
+
+    questionText.setFont(font);
+    questionText.setCharacterSize(fontSize);
+    questionText.setFillColor(sf::Color::White);
+    questionText.setString(wrap(question, fontSize, maxTextWidth));
+    questionText.setPosition(padding, padding);
+
+    // The answer goes on its own line under the question
+    answerText.setFont(font);
+    answerText.setCharacterSize(30);
+    answerText.setFillColor(sf::Color::White);
+    answerText.setPosition(padding, padding + questionText.getLocalBounds().top + questionText.getLocalBounds().height + font.getLineSpacing(fontSize));
+
+    layoutSize = windowSize;
+}
+
+void QuestionOverlay::draw(sf::RenderWindow& window) {
+    if (layoutSize != window.getSize()) {
+        layout(window.getSize());
+    }
+    countedDraw(window, box);
+    countedDraw(window, questionText);
+    countedDraw(window, answerText);
+}
+
+const char* PHASE_NAMES[PHASE_COUNT] = { "events", "update", "maze", "sprites", "overlays", "display" };
+const sf::Color PHASE_COLORS[PHASE_COUNT] = {
+    sf::Color(120, 120, 255), sf::Color(255, 160, 0), sf::Color(0, 200, 0),
+    sf::Color(0, 220, 220), sf::Color(220, 0, 220), sf::Color(160, 160, 160) };
+
+FrameProfiler::FrameProfiler() : phaseStart(0), phase(PHASE_COUNT), history(FRAME_HISTORY * PHASE_COUNT, 0.0f), next(0), frames(0) {
+    std::fill(current, current + PHASE_COUNT, 0.0f);
+}
+
+void FrameProfiler::beginFrame() {
+    std::fill(current, current + PHASE_COUNT, 0.0f);
+    phase = PHASE_COUNT;
+    phaseStart = clock.getElapsedTime().asMicroseconds();
+}
+
+// Ends the running phase and starts the given one. A phase may be entered several times in a frame.
+void FrameProfiler::begin(FramePhase newPhase) {
+    sf::Int64 now = clock.getElapsedTime().asMicroseconds();
+    if (phase < PHASE_COUNT) {
+        current[phase] += (now - phaseStart) / 1000.0f;
+    }
+    phase = newPhase;
+    phaseStart = now;
+}
+
+// Adds time measured elsewhere, such as on another thread, to the current frame
+void FrameProfiler::add(FramePhase phase, float milliseconds) {
+    current[phase] += milliseconds;
+}
+
+void FrameProfiler::endFrame() {
+    if (phase < PHASE_COUNT) {
+        current[phase] += (clock.getElapsedTime().asMicroseconds() - phaseStart) / 1000.0f;
+        phase = PHASE_COUNT;
+    }
+    std::copy(current, current + PHASE_COUNT, history.begin() + next * PHASE_COUNT);
+    next = (next + 1) % FRAME_HISTORY;
+    frames = std::min(frames + 1, FRAME_HISTORY);
+}
+
+// Frame 0 is the oldest kept; phase PHASE_COUNT is the whole frame
+float FrameProfiler::frameTime(int frame, int phase) const {
+    int slot = (next - frames + frame + FRAME_HISTORY) % FRAME_HISTORY;
+    const float* times = &history[slot * PHASE_COUNT];
+    if (phase < PHASE_COUNT) {
+        return times[phase];
+    }
+    float total = 0;
+    for (int i = 0; i < PHASE_COUNT; ++i) {
+        total += times[i];
+    }
+    return total;
+}
+
+float FrameProfiler::percentile(int phase, float fraction) const {
+    if (frames == 0) {
+        return 0;
+    }
+    std::vector<float> times(frames);
+    for (int i = 0; i < frames; ++i) {
+        times[i] = frameTime(i, phase);
+    }
+    size_t rank = std::min(static_cast<size_t>(fraction * frames), times.size() - 1);
+    std::nth_element(times.begin(), times.begin() + rank, times.end());
+    return times[rank];
+}
+
+float FrameProfiler::maximum(int phase) const {
+    float longest = 0;
+    for (int i = 0; i < frames; ++i) {
+        longest = std::max(longest, frameTime(i, phase));
+    }
+    return longest;
+}
+
+bool FrameProfiler::exportCsv(const std::string& path) const {
+    std::ofstream out(path);
+    out << "frame";
+    for (int i = 0; i < PHASE_COUNT; ++i) {
+        out << "," << PHASE_NAMES[i] << "_ms";
+    }
+    out << ",total_ms\n";
+    for (int frame = 0; frame < frames; ++frame) {
+        out << frame;
+        for (int i = 0; i <= PHASE_COUNT; ++i) {
+            out << "," << frameTime(frame, i);
+        }
+        out << "\n";
+    }
+    return static_cast<bool>(out);
+}
+
+// Draws a table of p50, p99 and max per phase and a graph of the kept frames, newest on the right, each bar
+// stacked by phase. The horizontal line marks 1/60 s.
+void FrameProfiler::draw(sf::RenderWindow& window, const sf::Font& font) const {
+    const float left = 10, top = 10, graphHeight = 200, pixelsPerMs = graphHeight / 50;
+    const unsigned int fontSize = 14;
+    const float lineHeight = font.getLineSpacing(fontSize);
+
+    sf::RectangleShape background(sf::Vector2f(FRAME_HISTORY + 20, graphHeight + lineHeight * (PHASE_COUNT + 2) + 20));
+    background.setPosition(left - 10, top - 10);
+    background.setFillColor(sf::Color(0, 0, 0, 200));
+    countedDraw(window, background);
+
+    // One text per column, as the font is not monospaced
+    std::string columns[4] = { "ms\n", "p50\n", "p99\n", "max\n" };
+    for (int i = 0; i <= PHASE_COUNT; ++i) {
+        columns[0] += std::string(i < PHASE_COUNT ? PHASE_NAMES[i] : "total") + "\n";
+        float values[3] = { percentile(i, 0.5f), percentile(i, 0.99f), maximum(i) };
+        for (int j = 0; j < 3; ++j) {
+            char number[16];
+            std::snprintf(number, sizeof(number), "%.2f\n", values[j]);
+            columns[j + 1] += number;
+        }
+    }
+    for (int j = 0; j < 4; ++j) {
+        sf::Text text(columns[j], font, fontSize);
+        text.setPosition(left + j * 80, top);
+        countedDraw(window, text);
+    }
+
+    float baseline = top + lineHeight * (PHASE_COUNT + 2) + graphHeight;
+    sf::VertexArray bars(sf::Lines);
+    for (int frame = 0; frame < frames; ++frame) {
+        float x = left + FRAME_HISTORY - frames + frame + 0.5f;
+        float y = baseline;
+        for (int i = 0; i < PHASE_COUNT; ++i) {
+            float height = std::min(frameTime(frame, i) * pixelsPerMs, y - (baseline - graphHeight));
+            bars.append(sf::Vertex(sf::Vector2f(x, y), PHASE_COLORS[i]));
+            bars.append(sf::Vertex(sf::Vector2f(x, y - height), PHASE_COLORS[i]));
+            y -= height;
+        }
+    }
+    float target = baseline - 1000.0f / 60 * pixelsPerMs;
+    bars.append(sf::Vertex(sf::Vector2f(left, target), sf::Color::White));
+    bars.append(sf::Vertex(sf::Vector2f(left + FRAME_HISTORY, target), sf::Color::White));
+    countedDraw(window, bars);
+}
+
+GameRenderer::GameRenderer(sf::RenderWindow& window, sf::Font& font, int rows, int cols)
+    : window(window), font(font), menu(font), maze(rows, cols), player(0, 0), hint(maze), questionOverlay(font) {
+}
+
+GameRenderer::~GameRenderer() {
+    stop();
+}
+
+// The window's context moves to the render thread; the caller keeps polling the window's events
+void GameRenderer::start(bool continuousRedraw, const sf::Clock& clock) {
+    continuous = continuousRedraw;
+    gameClock = &clock;
+    running = true;
+    window.setActive(false);
+    thread = std::thread(&GameRenderer::run, this);
+}
+
+void GameRenderer::stop() {
+    if (!thread.joinable()) return;
+    {
+        std::lock_guard<std::mutex> lock(wakeMutex);
+        running = false;
+    }
+    wake.notify_one();
+    thread.join();
+    capture.reset();
+}
+
+void GameRenderer::publish(GameSnapshot snapshot) {
+    snapshots.back() = std::move(snapshot);
+    snapshots.publish();
+    {
+        std::lock_guard<std::mutex> lock(wakeMutex);
+        published = true;
+    }
+    wake.notify_one();
+}
+
+void GameRenderer::run() {
+    window.setActive(true);
+    while (running) {
+        bool animating = snapshots.front().previousPosition != snapshots.front().position;
+        if (!continuous && !animating) {
+            std::unique_lock<std::mutex> lock(wakeMutex);
+            wake.wait(lock, [this]() { return published || !running; });
+            published = false;
+        }
+        if (!running) break;
+
+        snapshots.update();
+        const GameSnapshot& snapshot = snapshots.front();
+
+        profiler.beginFrame();
+        profiler.add(PHASE_EVENTS, static_cast<float>(snapshot.eventMs - eventMs));
+        profiler.add(PHASE_UPDATE, static_cast<float>(snapshot.updateMs - updateMs));
+        eventMs = snapshot.eventMs;
+        updateMs = snapshot.updateMs;
+        profiler.begin(PHASE_UPDATE);
+        apply(snapshot);
+        drawFrame(snapshot);
+        profiler.endFrame();
+        lastFrameDraws = drawCounters;
+        drawCounters.reset();
+        ++frames;
+    }
+    window.setActive(false);
+}
+
+// Brings the render thread's maze, player, hint and overlays up to date with a snapshot
+void GameRenderer::apply(const GameSnapshot& snapshot) {
+    if (snapshot.layout != layout) {
+        layout = snapshot.layout;
+        if (layout) {
+            maze.load(*layout);
+        }
+        hintShown = false;
+    }
+
+    // Checkpoints answered since the last snapshot
+    for (const auto& pos : maze.getCheckpointPositions()) {
+        int index = maze.getIndex(pos.first, pos.second);
+        if (maze.isCheckpoint(pos.first, pos.second)
+            && std::find(snapshot.checkpoints.begin(), snapshot.checkpoints.end(), index) == snapshot.checkpoints.end()) {
+            maze.removeCheckpoint(pos.first, pos.second);
+        }
+    }
+
+    bool moved = player.row != snapshot.playerRow || player.col != snapshot.playerCol;
+    player.row = snapshot.playerRow;
+    player.col = snapshot.playerCol;
+    float alpha = (gameClock->getElapsedTime() - snapshot.tickTime).asSeconds() / TICK_SECONDS;
+    alpha = std::max(0.0f, std::min(1.0f, alpha));
+    player.position = snapshot.previousPosition + (snapshot.position - snapshot.previousPosition) * alpha;
+    if (snapshot.showHint && layout) {
+        if (!hintShown) {
+            hint.reset(player.row, player.col);
+        }
+        else if (moved) {
+            hint.moveStart(player.row, player.col);
+        }
+    }
+    hintShown = snapshot.showHint && layout;
+
+    if (snapshot.question != question) {
+        question = snapshot.question;
+        questionOverlay.setQuestion(question);
+        answer.clear();
+    }
+    if (snapshot.answer != answer) {
+        answer = snapshot.answer;
+        questionOverlay.setAnswer(answer);
+    }
+
+    if (snapshot.csvRequests != csvRequests) {
+        csvRequests = snapshot.csvRequests;
+        if (profiler.exportCsv("frame_times.csv")) {
+            std::cout << "Frame times written to frame_times.csv\n";
+        }
+        else {
+            std::cerr << "Error writing frame_times.csv\n";
+        }
+    }
+}
+
+// Draws the maze, hint and player, with the view following the player when the maze scrolls, then the overlays
+void GameRenderer::drawFrame(const GameSnapshot& snapshot) {
+    profiler.begin(PHASE_MAZE);
+    window.clear();
+    if (!snapshot.gameStarted) {
+        profiler.begin(PHASE_OVERLAYS);
+        menu.draw(window);
+    }
+    else {
+        if (fog) {
+            fog->refresh();
+        }
+        window.setView(maze.getView(window, player.position + sf::Vector2f(0.5f, 0.5f), snapshot.zoom));
+        maze.draw(window);
+        if (hintShown) {
+            profiler.begin(PHASE_OVERLAYS);
+            hint.draw(window);
+        }
+        profiler.begin(PHASE_SPRITES);
+        sprites.begin(window);
+        maze.drawMarkers(sprites);
+        player.draw(sprites);
+        sprites.draw(window);
+        profiler.begin(PHASE_OVERLAYS);
+        if (fog) {
+            fog->draw(window);
+        }
+        window.setView(window.getDefaultView());
+        if (fog && maze.isScrolling()) {
+            fog->drawMinimap(window, player.position);
+        }
+
+        if (snapshot.questionActive) {
+            questionOverlay.draw(window);
+        }
+        if (snapshot.gameWon) {
+            sf::Text congratulations("Congratulations! You won!", font, 50);
+
+            // Adjust font size dynamically based on window dimensions
+            float fontSize = window.getSize().x / 20; // Adjust divisor for different aspect ratios
+            congratulations.setCharacterSize(static_cast<unsigned int>(fontSize));
+
+            congratulations.setFillColor(sf::Color::Green);
+
+            // Center the text in the window
+            sf::FloatRect textRect = congratulations.getLocalBounds();
+            congratulations.setOrigin(textRect.left + textRect.width / 2.0f,
+                textRect.top + textRect.height / 2.0f);
+            congratulations.setPosition(window.getSize().x / 2.0f, window.getSize().y / 2.0f);
+
+            countedDraw(window, congratulations);
+        }
+    }
+    if (snapshot.showProfiler) {
+        profiler.begin(PHASE_OVERLAYS);
+        profiler.draw(window, font);
+
+        sf::Text counters(lastFrameDraws.describe(), font, 14);
+        counters.setPosition(10, window.getSize().y - 30.0f);
+        countedDraw(window, counters);
+    }
+    profiler.begin(PHASE_DISPLAY);
+    if (capture) {
+        capture->capture(window);
+    }
+    window.display();
+}
+
+// Boards are laid out in a near-square grid with a cell's width of space between them. Every board gets its
+// own maze and a walking speed of its own, so the players drift apart.
+SpectatorGrid::SpectatorGrid(int boardCount, int rows, int cols)
+    : rows(rows), cols(cols), walls(sf::Quads), wallBuffer(sf::Quads, sf::VertexBuffer::Static) {
+    gridCols = static_cast<int>(std::ceil(std::sqrt(static_cast<double>(boardCount))));
+    gridRows = (boardCount + gridCols - 1) / gridCols;
+    boards.resize(boardCount);
+    for (int i = 0; i < boardCount; ++i) {
+        Board& board = boards[i];
+        board.maze.reset(new Maze(rows, cols));
+        board.maze->generate();
+        board.route = Solver(*board.maze).bfs(0, board.maze->getExitIndex());
+        board.speed = PLAYER_SPEED * (0.5f + 0.5f * rand() / RAND_MAX);
+        board.transform.translate(static_cast<float>(i % gridCols * (cols + 1)), static_cast<float>(i / gridCols * (rows + 1)));
+    }
+}
+
+// Advances every player one simulation tick along its route, back to the start once it reaches the exit
+void SpectatorGrid::tick() {
+    for (Board& board : boards) {
+        board.previousPosition = board.player.position;
+        if (!board.player.isMoving()) {
+            if (board.step + 1 >= board.route.size()) {
+                board.step = 0;
+                board.player.placeAt(0, 0);
+                board.previousPosition = board.player.position;
+                continue;
+            }
+            int next = board.route[++board.step];
+            board.player.move(next % cols - board.player.col, next / cols - board.player.row);
+        }
+        board.player.step(board.speed * TICK_SECONDS);
+    }
+}
+
+// The whole grid with half a cell of margin, stretched to the target like a fitted maze
+sf::View SpectatorGrid::getView() const {
+    return sf::View(sf::FloatRect(-0.5f, -0.5f, static_cast<float>(gridCols * (cols + 1)), static_cast<float>(gridRows * (rows + 1))));
+}
+
+// Builds every board's walls into one vertex array, uploads it, and lays out the static sprites. The target
+// already has the grid's view set.
+void SpectatorGrid::build(const sf::RenderTarget& target) {
+    float thickness = getWallThickness(target);
+    walls.clear();
+    for (Board& board : boards) {
+        board.firstVertex = walls.getVertexCount();
+        board.maze->appendWalls(walls, thickness, sf::IntRect(0, 0, cols, rows));
+        board.vertexCount = walls.getVertexCount() - board.firstVertex;
+    }
+
+    useBuffer = false;
+    if (!sf::VertexBuffer::isAvailable()) {
+        std::cerr << "Vertex buffers are not available, drawing the boards from memory\n";
+    }
+    else if (!wallBuffer.create(walls.getVertexCount()) || !wallBuffer.update(&walls[0])) {
+        std::cerr << "Error uploading the boards' vertex buffer, drawing them from memory\n";
+    }
+    else {
+        useBuffer = true;
+        walls.clear();
+    }
+
+    markers.begin(target);
+    for (const Board& board : boards) {
+        markers.setTransform(board.transform);
+        board.maze->drawMarkers(markers);
+    }
+    builtFor = target.getSize();
+}
+
+// Draws every board, with the players alpha of the way from their previous tick to the last one
+void SpectatorGrid::draw(sf::RenderTarget& target, float alpha) {
+    target.setView(getView());
+    if (target.getSize() != builtFor) {
+        build(target);
+    }
+
+    for (const Board& board : boards) {
+        if (board.vertexCount == 0) continue;
+        if (useBuffer) {
+            countedDraw(target, wallBuffer, board.firstVertex, board.vertexCount, sf::RenderStates(board.transform));
+        }
+        else {
+            countedDraw(target, &walls[board.firstVertex], board.vertexCount, sf::Quads, sf::RenderStates(board.transform));
+        }
+    }
+    markers.draw(target);
+
+    players.begin(target);
+    for (const Board& board : boards) {
+        Player shown = board.player;
+        shown.position = board.previousPosition + (board.player.position - board.previousPosition) * alpha;
+        players.setTransform(board.transform);
+        shown.draw(players);
+    }
+    players.draw(target);
+    target.setView(target.getDefaultView());
+}
+
+Maze::Maze(int rows, int cols) : rows(rows), cols(cols), geometry(sf::Quads), buffer(sf::Quads, sf::VertexBuffer::Static) {
+    cells.reserve(static_cast<size_t>(rows) * cols);
+    for (int i = 0; i < rows; ++i) {
+        for (int j = 0; j < cols; ++j) {
+            cells.push_back(Cell(i, j));
+        }
+    }
+}
+
+void Maze::generateExit() {
+    int side = rand() % 4;
+    int cellIndex;
+    switch (side) {
+    case 0: cellIndex = rand() % cols; connectNeighbors(cells[cellIndex], cells[cellIndex + cols]); break;
+    case 1: cellIndex = cols * (rows - 1) + (rand() % cols); connectNeighbors(cells[cellIndex], cells[cellIndex + 1]); break;
+    case 2: cellIndex = cols * (rows - 1) + (rand() % cols); connectNeighbors(cells[cellIndex], cells[cellIndex - cols]); break;
+    case 3: cellIndex = rand() % cols; connectNeighbors(cells[cellIndex], cells[cellIndex - 1]); break;
+    }
+}
+
+void Maze::generate() {
+    std::stack<Cell*> stack;
+    Cell* current = &cells[0];
+    current->visited = true;
+
+    while (true) {
+        std::vector<Cell*> unvisitedNeighbors;
+        for (int i = 0; i < 4; ++i) {
+            int next_row = current->row + (i == 0 ? -1 : (i == 2 ? 1 : 0));
+            int next_col = current->col + (i == 1 ? 1 : (i == 3 ? -1 : 0));
+            if (isValid(next_row, next_col) && !cells[getIndex(next_row, next_col)].visited) {
+                unvisitedNeighbors.push_back(&cells[getIndex(next_row, next_col)]);
+            }
+        }
+
+        if (!unvisitedNeighbors.empty()) {
+            Cell* next = unvisitedNeighbors[rand() % unvisitedNeighbors.size()];
+            connectNeighbors(*current, *next);
+            stack.push(current);
+            current = next;
+            current->visited = true;
+        }
+        else if (!stack.empty()) {
+            current = stack.top();
+            stack.pop();
+        }
+        else {
+            break;
+        }
+    }
+
+    generateExit();
+
+    checkpointPositions.clear();
+    std::vector<std::pair<int, int>> positions = { {8,22}, {13,15}, {7,0}, {15,7}, {29,11}, {21,39}, {22,27} };
+    for (const auto& pos : positions) {
+        int row = pos.first;
+        int col = pos.second;
+        if (isValid(row, col)) {
+            cells[getIndex(row, col)].checkpoint = true;
+            checkpointPositions.push_back(pos);
+        }
+    }
+    layoutChanged();
+}
+
+// Takes the walls and checkpoints of another maze of the same size from its packed layout, such as the game's
+// own maze published to the render thread. Only the bits are copied into the existing cells.
+void Maze::load(const std::vector<uint8_t>& layout) {
+    checkpointPositions.clear();
+    for (size_t i = 0; i < cells.size(); ++i) {
+        Cell& cell = cells[i];
+        for (int d = 0; d < 4; ++d) {
+            cell.walls[d] = (layout[i] >> d) & 1;
+        }
+        cell.checkpoint = (layout[i] & LAYOUT_CHECKPOINT) != 0;
+        if (cell.checkpoint) {
+            checkpointPositions.push_back(std::make_pair(cell.row, cell.col));
+        }
+    }
+    layoutChanged();
+}
+
+// Rebuilds everything derived from the cells after they were generated or loaded
+void Maze::layoutChanged() {
+    distancesBuilt = false;
+    geometryBuilt = false;
+    cellTextureValid = false;
+    chunks.clear();
+    pyramid.clear();
+}
+
+void Maze::buildGeometry() {
+    geometry.clear();
+    cellVertices.resize(cells.size() + 1);
+    for (int i = 0; i < cells.size(); ++i) {
+        cellVertices[i] = geometry.getVertexCount();
+        appendCell(geometry, i, static_cast<float>(cells[i].col), static_cast<float>(cells[i].row), sf::Vector2f(1, 1));
+    }
+    cellVertices[cells.size()] = geometry.getVertexCount();
+    geometryBuilt = true;
+    layerValid = false;
+    bufferValid = false;
+}
+
+// Appends the four wall quads of a cell, transparent where open. The exit and checkpoints are sprites, drawn
+// by drawMarkers.
+void Maze::appendCell(sf::VertexArray& vertices, int index, float x, float y, sf::Vector2f size) const {
+    const Cell& cell = cells[index];
+    for (int j = 0; j < 4; ++j) {
+        sf::Color color = cell.walls[j] ? sf::Color::White : sf::Color::Transparent;
+        switch (j) {
+        case 0: appendQuad(vertices, x, y, size.x, wallThickness, color); break;
+        case 1: appendQuad(vertices, x + size.x, y, wallThickness, size.y, color); break;
+        case 2: appendQuad(vertices, x, y + size.y, size.x, wallThickness, color); break;
+        case 3: appendQuad(vertices, x, y, wallThickness, size.y, color); break;
+        }
+    }
+}
+
+// Adds the exit and the remaining checkpoints to the frame's sprite layer
+void Maze::drawMarkers(SpriteLayer& sprites) const {
+    int exit = getExitIndex();
+    sprites.add(SPRITE_EXIT, sf::FloatRect(static_cast<float>(exit % cols), static_cast<float>(exit / cols), 1, 1));
+    for (const auto& pos : checkpointPositions) {
+        if (cells[getIndex(pos.first, pos.second)].checkpoint) {
+            sprites.add(SPRITE_CHECKPOINT, sf::FloatRect(static_cast<float>(pos.second), static_cast<float>(pos.first), 1, 1));
+        }
+    }
+}
+
+// Appends a quad for each closed wall of the cells in area (columns by rows) in world units and nothing for
+// open ones, for geometry that is rebuilt rather than patched when a wall changes. A wall between two cells is
+// added once, as the top or left wall of the lower or right cell, even when that cell is outside area.
+void Maze::appendWalls(sf::VertexArray& vertices, float thickness, const sf::IntRect& area) const {
+    for (int row = area.top; row < area.top + area.height; ++row) {
+        for (int col = area.left; col < area.left + area.width; ++col) {
+            const Cell& cell = cells[getIndex(row, col)];
+            float x = static_cast<float>(col);
+            float y = static_cast<float>(row);
+            if (cell.walls[0]) appendQuad(vertices, x, y, 1, thickness, sf::Color::White);
+            if (cell.walls[3]) appendQuad(vertices, x, y, thickness, 1, sf::Color::White);
+            if (cell.walls[1] && col == cols - 1) appendQuad(vertices, x + 1, y, thickness, 1, sf::Color::White);
+            if (cell.walls[2] && row == rows - 1) appendQuad(vertices, x, y + 1, 1, thickness, sf::Color::White);
+        }
+    }
+}
+
+int Maze::getChunk(int index) const {
+    int chunksPerRow = (cols + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    return (index / cols / CHUNK_SIZE) * chunksPerRow + (index % cols) / CHUNK_SIZE;
+}
+
+// Draws the chunks that intersect the target's current view, building any that are missing.
+// Chunks out of view are dropped once more than MAX_CACHED_CHUNKS are cached.
+void Maze::drawChunks(sf::RenderWindow& window) {
+    const sf::View& view = window.getView();
+    float pixelsPerCell = window.getSize().x / view.getSize().x;
+    if (pixelsPerCell < LOD_CELL_SIZE) {
+        if (!pyramid.isBuilt()) {
+            pyramid.build(*this);
+        }
+        pyramid.draw(window, pixelsPerCell);
+        return;
+    }
+
+    sf::Vector2f topLeft = view.getCenter() - view.getSize() / 2.0f;
+    sf::Vector2f bottomRight = view.getCenter() + view.getSize() / 2.0f;
+    int chunksPerRow = (cols + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    int chunksPerCol = (rows + CHUNK_SIZE - 1) / CHUNK_SIZE;
+
+    // Walls reach wallThickness past their cell, hence the margin on the top-left side
+    int firstCol = std::max(0, static_cast<int>(std::floor((topLeft.x - wallThickness) / CHUNK_SIZE)));
+    int firstRow = std::max(0, static_cast<int>(std::floor((topLeft.y - wallThickness) / CHUNK_SIZE)));
+    int lastCol = std::min(chunksPerRow - 1, static_cast<int>(std::floor(bottomRight.x / CHUNK_SIZE)));
+    int lastRow = std::min(chunksPerCol - 1, static_cast<int>(std::floor(bottomRight.y / CHUNK_SIZE)));
+
+    std::vector<int> visible;
+    for (int chunkRow = firstRow; chunkRow <= lastRow; ++chunkRow) {
+        for (int chunkCol = firstCol; chunkCol <= lastCol; ++chunkCol) {
+            int chunk = chunkRow * chunksPerRow + chunkCol;
+            visible.push_back(chunk);
+
+            auto found = chunks.find(chunk);
+            if (found == chunks.end()) {
+                sf::VertexArray& vertices = chunks[chunk];
+                vertices.setPrimitiveType(sf::Quads);
+                int left = chunkCol * CHUNK_SIZE;
+                int top = chunkRow * CHUNK_SIZE;
+                appendWalls(vertices, wallThickness, sf::IntRect(left, top, std::min(cols, left + CHUNK_SIZE) - left, std::min(rows, top + CHUNK_SIZE) - top));
+                found = chunks.find(chunk);
+            }
+            countedDraw(window, found->second);
+        }
+    }
+
+    if (chunks.size() > MAX_CACHED_CHUNKS) {
+        for (auto it = chunks.begin(); it != chunks.end(); ) {
+            if (std::find(visible.begin(), visible.end(), it->first) == visible.end()) {
+                it = chunks.erase(it);
+            }
+            else {
+                ++it;
+            }
+        }
+    }
+}
+
+void Maze::setScrolling(bool scrolling) {
+    this->scrolling = scrolling;
+}
+
+bool Maze::isScrolling() const {
+    return scrolling;
+}
+
+// Pixels per cell when the whole maze is fitted to a target of the given size
+sf::Vector2f Maze::getFittedCellSize(sf::Vector2u targetSize) const {
+    return sf::Vector2f(static_cast<float>(targetSize.x - 2 * BORDER_SIZE) / cols,
+        static_cast<float>(targetSize.y - 2 * BORDER_SIZE) / rows);
+}
+
+// View mapping world units to the target: the whole maze inside a border of BORDER_SIZE pixels, or when
+// scrolling SCROLL_CELL_SIZE pixels per cell divided by zoom, centred on focus
+sf::View Maze::getView(const sf::RenderTarget& target, sf::Vector2f focus, float zoom) const {
+    sf::Vector2f size(target.getSize());
+    if (scrolling) {
+        return sf::View(focus, size * (zoom / SCROLL_CELL_SIZE));
+    }
+    sf::Vector2f cellSize = getFittedCellSize(target.getSize());
+    return sf::View(sf::FloatRect(-BORDER_SIZE / cellSize.x, -BORDER_SIZE / cellSize.y, size.x / cellSize.x, size.y / cellSize.y));
+}
+
+// Repaints one cell of the offscreen layer. The view is narrowed to the whole pixels covering the cell (its
+// right and bottom walls included), which clips the redraw, and the cell and its eight neighbours are drawn
+// again in their original order so overlapping walls come out exactly as in a full render.
+void Maze::redrawCell(int index) {
+    int row = index / cols;
+    int col = index % cols;
+    float pixelsPerCellX = layer.getSize().x / layerArea.width;
+    float pixelsPerCellY = layer.getSize().y / layerArea.height;
+    int left = std::max(0, static_cast<int>(std::floor((col - layerArea.left) * pixelsPerCellX)));
+    int top = std::max(0, static_cast<int>(std::floor((row - layerArea.top) * pixelsPerCellY)));
+    int right = std::min(static_cast<int>(std::ceil((col + 1 + wallThickness - layerArea.left) * pixelsPerCellX)) + 1, static_cast<int>(layer.getSize().x));
+    int bottom = std::min(static_cast<int>(std::ceil((row + 1 + wallThickness - layerArea.top) * pixelsPerCellY)) + 1, static_cast<int>(layer.getSize().y));
+    if (right <= left || bottom <= top) return;
+
+    // The world rectangle that lands exactly on those pixels, so the patch lines up with the full render
+    sf::FloatRect area(layerArea.left + left / pixelsPerCellX, layerArea.top + top / pixelsPerCellY,
+        (right - left) / pixelsPerCellX, (bottom - top) / pixelsPerCellY);
+    sf::View view(area);
+    view.setViewport(sf::FloatRect(static_cast<float>(left) / layer.getSize().x, static_cast<float>(top) / layer.getSize().y,
+        static_cast<float>(right - left) / layer.getSize().x, static_cast<float>(bottom - top) / layer.getSize().y));
+
+    sf::VertexArray patch(sf::Quads);
+    appendQuad(patch, area.left, area.top, area.width, area.height, sf::Color::Black);
+    for (int i = std::max(row - 1, 0); i <= std::min(row + 1, rows - 1); ++i) {
+        for (int j = std::max(col - 1, 0); j <= std::min(col + 1, cols - 1); ++j) {
+            int cell = getIndex(i, j);
+            for (size_t v = cellVertices[cell]; v < cellVertices[cell + 1]; ++v) {
+                patch.append(geometry[v]);
+            }
+        }
+    }
+
+    layer.setView(view);
+    countedDraw(layer, patch);
+    layer.setView(sf::View(layerArea));
+}
+
+// Called after a cell changed (and its vertices were patched, if built) to bring the render paths up to date
+void Maze::cellChanged(int index) {
+    if (!chunks.empty()) {
+        chunks.erase(getChunk(index));
+    }
+    if (pyramid.isBuilt()) {
+        pyramid.cellChanged(*this, index);
+    }
+    if (cellTextureValid) {
+        sf::Uint8 texel[4];
+        cellTexel(index, texel);
+        cellTexture.update(texel, 1, 1, index % cols, index / cols);
+    }
+    if (!geometryBuilt) return;
+    if (layerValid) {
+        dirtyCells.push_back(index);
+    }
+    if (bufferValid) {
+        size_t first = cellVertices[index];
+        buffer.update(&geometry[first], cellVertices[index + 1] - first, static_cast<unsigned int>(first));
+    }
+}
+
+void Maze::cellTexel(int index, sf::Uint8* texel) const {
+    const Cell& cell = cells[index];
+    texel[0] = static_cast<sf::Uint8>((cell.walls[0] ? 1 : 0) | (cell.walls[1] ? 2 : 0) | (cell.walls[2] ? 4 : 0) | (cell.walls[3] ? 8 : 0));
+    texel[1] = 0;
+    texel[2] = 0;
+    texel[3] = 255;
+}
+
+// GLSL 1.10 without integer operations, so it also runs on Mesa's software rasterizer.
+// Mirrors the vertex geometry in world units: a cell's top and left walls are its own first wallThickness,
+// and its right and bottom walls land on the first wallThickness of the neighbouring cells.
+const char* WALL_SHADER = R"(
+uniform sampler2D cells;
+uniform vec2 gridSize;
+uniform float wallThickness;
+
+float bit(float value, float b) {
+    return mod(floor(value / b), 2.0);
+}
+
+vec2 lookup(vec2 cell) {
+    if (cell.x < 0.0 || cell.y < 0.0 || cell.x >= gridSize.x || cell.y >= gridSize.y) return vec2(0.0);
+    vec4 data = texture2D(cells, (cell + 0.5) / gridSize);
+    return floor(data.rg * 255.0 + 0.5);
+}
+
+void main() {
+    vec2 local = gl_TexCoord[0].xy;
+    vec2 cell = floor(local);
+    vec2 inCell = local - cell;
+
+    vec2 own = lookup(cell);
+    float wall = 0.0;
+    if (inCell.y < wallThickness) wall += bit(own.x, 1.0) + bit(lookup(cell - vec2(0.0, 1.0)).x, 4.0);
+    if (inCell.x < wallThickness) wall += bit(own.x, 8.0) + bit(lookup(cell - vec2(1.0, 0.0)).x, 2.0);
+    gl_FragColor = wall > 0.5 ? vec4(1.0) : vec4(0.0, 0.0, 0.0, 1.0);
+}
+)";
+
+bool Maze::drawShaded(sf::RenderWindow& window) {
+    if (!shaderLoaded) {
+        if (!sf::Shader::isAvailable() || !wallShader.loadFromMemory(WALL_SHADER, sf::Shader::Fragment)) {
+            std::cerr << "Wall shader is not available, using the render texture cache\n";
+            return false;
+        }
+        shaderLoaded = true;
+    }
+    if (!cellTextureValid) {
+        if (static_cast<unsigned int>(std::max(rows, cols)) > sf::Texture::getMaximumSize() || !cellTexture.create(cols, rows)) {
+            std::cerr << "Maze is too large for a cell texture, using the render texture cache\n";
+            return false;
+        }
+        std::vector<sf::Uint8> pixels(cells.size() * 4);
+        for (int i = 0; i < cells.size(); ++i) {
+            cellTexel(i, &pixels[i * 4]);
+        }
+        cellTexture.update(pixels.data());
+        cellTextureValid = true;
+    }
+
+    wallShader.setUniform("cells", cellTexture);
+    wallShader.setUniform("gridSize", sf::Glsl::Vec2(static_cast<float>(cols), static_cast<float>(rows)));
+    float thickness = getWallThickness(window);
+    wallShader.setUniform("wallThickness", thickness);
+
+    // Texture coordinates carry the world position
+    float width = cols + thickness;
+    float height = rows + thickness;
+    sf::VertexArray quad(sf::Quads, 4);
+    quad[0] = sf::Vertex(sf::Vector2f(0, 0), sf::Vector2f(0, 0));
+    quad[1] = sf::Vertex(sf::Vector2f(width, 0), sf::Vector2f(width, 0));
+    quad[2] = sf::Vertex(sf::Vector2f(width, height), sf::Vector2f(width, height));
+    quad[3] = sf::Vertex(sf::Vector2f(0, height), sf::Vector2f(0, height));
+    countedDraw(window, quad, &wallShader);
+    return true;
+}
+
+// The layer is re-rendered when the window's size or view changes, as it holds the maze at window resolution
+bool Maze::drawCached(sf::RenderWindow& window) {
+    sf::View view = window.getView();
+    sf::FloatRect area(view.getCenter() - view.getSize() / 2.0f, view.getSize());
+    if (!layerValid || layer.getSize() != window.getSize() || area != layerArea) {
+        if (layer.getSize() != window.getSize() && !layer.create(window.getSize().x, window.getSize().y)) {
+            std::cerr << "Error creating maze render texture, drawing directly\n";
+            return false;
+        }
+        layerArea = area;
+        layer.setView(sf::View(layerArea));
+        layer.clear();
+        countedDraw(layer, geometry);
+        layer.display();
+        layerValid = true;
+        dirtyCells.clear();
+    }
+    else if (!dirtyCells.empty()) {
+        for (int index : dirtyCells) {
+            redrawCell(index);
+        }
+        layer.display();
+        dirtyCells.clear();
+    }
+
+    window.setView(window.getDefaultView());
+    countedDraw(window, sf::Sprite(layer.getTexture()));
+    window.setView(view);
+    return true;
+}
+
+bool Maze::drawBuffered(sf::RenderWindow& window) {
+    if (!bufferValid) {
+        if (!sf::VertexBuffer::isAvailable()) {
+            std::cerr << "Vertex buffers are not available, using the render texture cache\n";
+            return false;
+        }
+        if (!buffer.create(geometry.getVertexCount()) || !buffer.update(&geometry[0])) {
+            std::cerr << "Error uploading maze vertex buffer, using the render texture cache\n";
+            return false;
+        }
+        bufferValid = true;
+    }
+
+    countedDraw(window, buffer);
+    return true;
+}
+
+void Maze::setRenderMode(MazeRenderMode mode) {
+    renderMode = mode;
+}
+
+// Vertex geometry is rebuilt when the view calls for a different wall thickness: once for a fitted maze, and on
+// zoom steps below SCROLL_CELL_SIZE pixels per cell for the chunks
+void Maze::draw(sf::RenderWindow& window) {
+    float thickness = getWallThickness(window);
+    if (thickness != wallThickness) {
+        wallThickness = thickness;
+        geometryBuilt = false;
+        chunks.clear();
+    }
+
+    if (scrolling) {
+        drawChunks(window);
+        return;
+    }
+
+    // The shader path needs no vertex geometry at all
+    if (renderMode == RENDER_SHADER) {
+        if (drawShaded(window)) return;
+        renderMode = RENDER_CACHED;
+    }
+
+    if (!geometryBuilt) {
+        buildGeometry();
+    }
+
+    // A path that cannot run here falls back to the next simpler one for the rest of the game
+    if (renderMode == RENDER_BUFFER && !drawBuffered(window)) {
+        renderMode = RENDER_CACHED;
+    }
+    if (renderMode == RENDER_CACHED && !drawCached(window)) {
+        renderMode = RENDER_BATCHED;
+    }
+    if (renderMode == RENDER_BATCHED) {
+        countedDraw(window, geometry);
+    }
+}
+
+
+bool Maze::isWall(int row, int col, int dir) const {
+    if (!isValid(row, col)) return true;
+    return cells[getIndex(row, col)].walls[dir];
+}
+
+bool Maze::isCheckpoint(int row, int col) {
+    return cells[getIndex(row, col)].checkpoint;
+}
+
+// Checkpoints are sprites everywhere but in the pyramid, so only its tile is redrawn
+void Maze::removeCheckpoint(int row, int col) {
+    int index = getIndex(row, col);
+    cells[index].checkpoint = false;
+    if (pyramid.isBuilt()) {
+        pyramid.cellChanged(*this, index);
+    }
+}
+
+// Distance fields describe the maze as generated and are not refreshed here
+void Maze::setWall(int row, int col, int dir, bool wall) {
+    int nextRow = row + DIR_ROW[dir];
+    int nextCol = col + DIR_COL[dir];
+    cells[getIndex(row, col)].walls[dir] = wall;
+    if (isValid(nextRow, nextCol)) {
+        cells[getIndex(nextRow, nextCol)].walls[(dir + 2) % 4] = wall;
+    }
+
+    // Recolour the wall quads on both sides in place
+    sf::Color color = wall ? sf::Color::White : sf::Color::Transparent;
+    for (int side = 0; side < 2; ++side) {
+        int sideRow = side == 0 ? row : nextRow;
+        int sideCol = side == 0 ? col : nextCol;
+        int sideDir = side == 0 ? dir : (dir + 2) % 4;
+        if (!isValid(sideRow, sideCol)) continue;
+        int index = getIndex(sideRow, sideCol);
+        if (geometryBuilt) {
+            for (size_t v = 0; v < 4; ++v) {
+                geometry[cellVertices[index] + sideDir * 4 + v].color = color;
+            }
+        }
+        cellChanged(index);
+    }
+}
+
+// Writes a text header "MAZE <rows> <cols>" and then one byte per cell in row-major order,
+// bit d set when wall d is present
+void Maze::saveWalls(std::ostream& out) const {
+    out << "MAZE " << rows << " " << cols << "\n";
+    std::vector<char> row(cols);
+    for (int i = 0; i < rows; ++i) {
+        for (int j = 0; j < cols; ++j) {
+            const Cell& cell = cells[getIndex(i, j)];
+            row[j] = static_cast<char>((cell.walls[0] ? 1 : 0) | (cell.walls[1] ? 2 : 0) | (cell.walls[2] ? 4 : 0) | (cell.walls[3] ? 8 : 0));
+        }
+        out.write(row.data(), cols);
+    }
+}
+
+// One byte per cell in row-major order: bit d set when wall d is present, as in saveWalls, and
+// LAYOUT_CHECKPOINT on checkpoints
+std::vector<uint8_t> Maze::getLayout() const {
+    std::vector<uint8_t> layout(cells.size());
+    for (size_t i = 0; i < cells.size(); ++i) {
+        const Cell& cell = cells[i];
+        layout[i] = static_cast<uint8_t>((cell.walls[0] ? 1 : 0) | (cell.walls[1] ? 2 : 0) | (cell.walls[2] ? 4 : 0) | (cell.walls[3] ? 8 : 0)
+            | (cell.checkpoint ? LAYOUT_CHECKPOINT : 0));
+    }
+    return layout;
+}
+
+const std::vector<Cell>& Maze::getCells() const {
+    return cells;
+}
+
+int Maze::getIndex(int row, int col) const {
+    return row * cols + col;
+}
+
+int Maze::getRows() const {
+    return rows;
+}
+
+int Maze::getCols() const {
+    return cols;
+}
+
+int Maze::getExitIndex() const {
+    return getIndex(rows - 1, cols - 1);
+}
+
+const std::vector<std::pair<int, int>>& Maze::getCheckpointPositions() const {
+    return checkpointPositions;
+}
+
+// Source 0 is the exit, source k + 1 is checkpointPositions[k]
+void Maze::buildDistances() const {
+    std::vector<int> sources = { getExitIndex() };
+    for (const auto& pos : checkpointPositions) {
+        sources.push_back(getIndex(pos.first, pos.second));
+    }
+    distances.build(*this, sources);
+    distancesBuilt = true;
+}
+
+uint32_t Maze::distanceToExit(int row, int col) const {
+    if (!distancesBuilt) buildDistances();
+    return distances.get(0, getIndex(row, col));
+}
+
+uint32_t Maze::distanceToCheckpoint(int checkpoint, int row, int col) const {
+    if (!distancesBuilt) buildDistances();
+    return distances.get(checkpoint + 1, getIndex(row, col));
+}
+
+bool Maze::isValid(int row, int col) const {
+    return row >= 0 && row < rows && col >= 0 && col < cols;
+}
+
+void Maze::connectNeighbors(Cell& current, Cell& neighbor) {
+    int dx = neighbor.col - current.col;
+    int dy = neighbor.row - current.row;
+
+    if (dx == 1) {
+        current.walls[1] = false;
+        neighbor.walls[3] = false;
+    }
+    else if (dx == -1) {
+        current.walls[3] = false;
+        neighbor.walls[1] = false;
+    }
+    else if (dy == 1) {
+        current.walls[2] = false;
+        neighbor.walls[0] = false;
+    }
+    else if (dy == -1) {
+        current.walls[0] = false;
+        neighbor.walls[2] = false;
+    }
+}
+
+// Runs the BFS from every source in one pass: each frontier entry carries a bitmask of the sources
+// that reached the cell on the current level, so cells shared by several searches are expanded once.
+// Up to 64 sources go through the maze together; more than that take one pass per group of 64.
+void DistanceFields::build(const Maze& maze, const std::vector<int>& sources) {
+    const size_t count = maze.getCells().size();
+    const int cols = maze.getCols();
+    sourceCount = static_cast<int>(sources.size());
+    wide = count >= 0xFFFF;
+    narrowDistances.assign(wide ? 0 : count * sourceCount, 0xFFFF);
+    wideDistances.assign(wide ? count * sourceCount : 0, UNREACHABLE);
+
+    std::vector<uint64_t> reached(count);
+    std::vector<uint64_t> incoming(count);
+    std::vector<std::pair<int, uint64_t>> frontier;
+    std::vector<int> next;
+
+    for (int first = 0; first < sourceCount; first += 64) {
+        int group = std::min(64, sourceCount - first);
+        std::fill(reached.begin(), reached.end(), 0);
+        frontier.clear();
+        for (int k = 0; k < group; ++k) {
+            int cell = sources[first + k];
+            set(first + k, cell, 0);
+            if (reached[cell] == 0) {
+                frontier.push_back({ cell, 0 });
+            }
+            reached[cell] |= 1ull << k;
+        }
+        for (auto& entry : frontier) {
+            entry.second = reached[entry.first];
+        }
+
+        for (uint32_t level = 1; !frontier.empty(); ++level) {
+            next.clear();
+            for (const auto& entry : frontier) {
+                int row = entry.first / cols;
+                int col = entry.first % cols;
+                for (int dir = 0; dir < 4; ++dir) {
+                    if (maze.isWall(row, col, dir)) continue;
+                    int nextRow = row + DIR_ROW[dir];
+                    int nextCol = col + DIR_COL[dir];
+                    if (nextRow < 0 || nextRow >= maze.getRows() || nextCol < 0 || nextCol >= cols) continue;
+
+                    int neighbor = nextRow * cols + nextCol;
+                    uint64_t added = entry.second & ~reached[neighbor];
+                    if (added == 0) continue;
+                    reached[neighbor] |= added;
+                    if (incoming[neighbor] == 0) {
+                        next.push_back(neighbor);
+                    }
+                    incoming[neighbor] |= added;
+                    for (uint64_t bits = added; bits != 0; bits &= bits - 1) {
+                        int k = 0;
+                        while (!(bits & (1ull << k))) ++k;
+                        set(first + k, neighbor, level);
+                    }
+                }
+            }
+
+            frontier.clear();
+            for (int cell : next) {
+                frontier.push_back({ cell, incoming[cell] });
+                incoming[cell] = 0;
+            }
+        }
+    }
+}
+
+const uint32_t DistanceFields::UNREACHABLE;
+
+uint32_t DistanceFields::get(int source, int index) const {
+    size_t slot = static_cast<size_t>(index) * sourceCount + source;
+    if (wide) return wideDistances[slot];
+    uint16_t distance = narrowDistances[slot];
+    return distance == 0xFFFF ? UNREACHABLE : distance;
+}
+
+void DistanceFields::set(int source, int index, uint32_t distance) {
+    size_t slot = static_cast<size_t>(index) * sourceCount + source;
+    if (wide) {
+        wideDistances[slot] = distance;
+    }
+    else {
+        narrowDistances[slot] = static_cast<uint16_t>(distance);
+    }
+}
+
+// Colour of a cell seen from far away: the exit and checkpoints in their marker colours, other cells brighter
+// the more walls they have
+sf::Color getCellShade(const Maze& maze, int index) {
+    const Cell& cell = maze.getCells()[index];
+    if (index == maze.getExitIndex()) {
+        return sf::Color::Red;
+    }
+    if (cell.checkpoint) {
+        return sf::Color::Yellow;
+    }
+    sf::Uint8 shade = static_cast<sf::Uint8>(60 * (cell.walls[0] + cell.walls[1] + cell.walls[2] + cell.walls[3]));
+    return sf::Color(shade, shade, shade);
+}
+
+void MazePyramid::texel(const Maze& maze, int level, int x, int y, sf::Uint8* out) const {
+    if (level > 0) {
+        const sf::Uint8* pixel = &levels[level].pixels[(static_cast<size_t>(y) * levels[level].width + x) * 4];
+        std::copy(pixel, pixel + 4, out);
+        return;
+    }
+
+    sf::Color color = getCellShade(maze, maze.getIndex(y, x));
+    out[0] = color.r;
+    out[1] = color.g;
+    out[2] = color.b;
+    out[3] = 255;
+}
+
+// Recomputes one pixel of a level above 0 from the up to four pixels under it
+void MazePyramid::average(const Maze& maze, int level, int x, int y) {
+    const Level& below = levels[level - 1];
+    unsigned int sum[4] = { 0, 0, 0, 0 };
+    unsigned int count = 0;
+    for (int dy = 0; dy < 2; ++dy) {
+        for (int dx = 0; dx < 2; ++dx) {
+            if (2 * x + dx >= below.width || 2 * y + dy >= below.height) continue;
+            sf::Uint8 pixel[4];
+            texel(maze, level - 1, 2 * x + dx, 2 * y + dy, pixel);
+            for (int c = 0; c < 4; ++c) sum[c] += pixel[c];
+            ++count;
+        }
+    }
+    sf::Uint8* out = &levels[level].pixels[(static_cast<size_t>(y) * levels[level].width + x) * 4];
+    for (int c = 0; c < 4; ++c) {
+        out[c] = static_cast<sf::Uint8>(sum[c] / count);
+    }
+}
+
+void MazePyramid::build(const Maze& maze) {
+    levels.clear();
+    tileSize = std::min(PYRAMID_TILE_SIZE, sf::Texture::getMaximumSize());
+
+    int width = maze.getCols();
+    int height = maze.getRows();
+    for (int level = 0; ; ++level) {
+        levels.emplace_back();
+        Level& current = levels.back();
+        current.width = width;
+        current.height = height;
+        if (level > 0) {
+            current.pixels.resize(static_cast<size_t>(width) * height * 4);
+            for (int y = 0; y < height; ++y) {
+                for (int x = 0; x < width; ++x) {
+                    average(maze, level, x, y);
+                }
+            }
+        }
+
+        current.tilesPerRow = (width + tileSize - 1) / tileSize;
+        int tilesPerCol = (height + tileSize - 1) / tileSize;
+        current.tiles.resize(static_cast<size_t>(current.tilesPerRow) * tilesPerCol);
+        std::vector<sf::Uint8> tilePixels;
+        for (int ty = 0; ty < tilesPerCol; ++ty) {
+            for (int tx = 0; tx < current.tilesPerRow; ++tx) {
+                int tileWidth = std::min<int>(tileSize, width - tx * tileSize);
+                int tileHeight = std::min<int>(tileSize, height - ty * tileSize);
+                tilePixels.resize(static_cast<size_t>(tileWidth) * tileHeight * 4);
+                for (int y = 0; y < tileHeight; ++y) {
+                    for (int x = 0; x < tileWidth; ++x) {
+                        texel(maze, level, tx * tileSize + x, ty * tileSize + y, &tilePixels[(static_cast<size_t>(y) * tileWidth + x) * 4]);
+                    }
+                }
+                sf::Texture& tile = current.tiles[ty * current.tilesPerRow + tx];
+                tile.create(tileWidth, tileHeight);
+                tile.update(tilePixels.data());
+                tile.setSmooth(true);
+            }
+        }
+
+        if (width == 1 && height == 1) break;
+        width = (width + 1) / 2;
+        height = (height + 1) / 2;
+    }
+}
+
+void MazePyramid::clear() {
+    levels.clear();
+}
+
+// Walks the changed cell up the pyramid, updating one pixel per level
+void MazePyramid::cellChanged(const Maze& maze, int index) {
+    int x = index % maze.getCols();
+    int y = index / maze.getCols();
+    for (size_t level = 0; level < levels.size(); ++level) {
+        if (level > 0) {
+            average(maze, static_cast<int>(level), x, y);
+        }
+        sf::Uint8 pixel[4];
+        texel(maze, static_cast<int>(level), x, y, pixel);
+        Level& current = levels[level];
+        current.tiles[(y / tileSize) * current.tilesPerRow + x / tileSize].update(pixel, 1, 1, x % tileSize, y % tileSize);
+        x /= 2;
+        y /= 2;
+    }
+}
+
+// Picks the level with about one pixel per screen pixel and draws its tiles that are in view
+void MazePyramid::draw(sf::RenderTarget& target, float pixelsPerCell) {
+    int level = 0;
+    while (level + 1 < static_cast<int>(levels.size()) && pixelsPerCell * (1 << (level + 1)) <= 1.0f) {
+        ++level;
+    }
+    const Level& current = levels[level];
+    float texelSize = static_cast<float>(1 << level);
+
+    const sf::View& view = target.getView();
+    sf::FloatRect visible(view.getCenter() - view.getSize() / 2.0f, view.getSize());
+    for (size_t i = 0; i < current.tiles.size(); ++i) {
+        int tx = static_cast<int>(i) % current.tilesPerRow;
+        int ty = static_cast<int>(i) / current.tilesPerRow;
+        sf::Sprite sprite(current.tiles[i]);
+        sprite.setPosition(tx * tileSize * texelSize, ty * tileSize * texelSize);
+        sprite.setScale(texelSize, texelSize);
+        if (sprite.getGlobalBounds().intersects(visible)) {
+            countedDraw(target, sprite);
+        }
+    }
+}
+
+// Markers stored per cell while searching: the direction the search entered the cell through,
+// or one of these two values
+const uint8_t UNVISITED = 0xFF;
+const uint8_t SEARCH_ORIGIN = 4;
+
+int Solver::neighbor(int index, int dir) const {
+    int cols = maze.getCols();
+    int row = index / cols;
+    int col = index % cols;
+    int nextRow = row + DIR_ROW[dir];
+    int nextCol = col + DIR_COL[dir];
+    if (nextRow < 0 || nextRow >= maze.getRows() || nextCol < 0 || nextCol >= cols || maze.isWall(row, col, dir)) {
+        return -1;
+    }
+    return nextRow * cols + nextCol;
+}
+
+std::vector<int> Solver::bfs(int from, int to) {
+    std::vector<uint8_t> cameFrom(maze.getCells().size(), UNVISITED);
+    std::vector<int> queue;
+    queue.push_back(from);
+    cameFrom[from] = SEARCH_ORIGIN;
+
+    size_t head = 0;
+    while (head < queue.size() && cameFrom[to] == UNVISITED) {
+        int current = queue[head++];
+        for (int dir = 0; dir < 4; ++dir) {
+            int next = neighbor(current, dir);
+            if (next >= 0 && cameFrom[next] == UNVISITED) {
+                cameFrom[next] = static_cast<uint8_t>(dir);
+                queue.push_back(next);
+            }
+        }
+    }
+    explored = queue.size();
+
+    std::vector<int> path;
+    if (cameFrom[to] == UNVISITED) return path;
+    for (int current = to; ; ) {
+        path.push_back(current);
+        int dir = cameFrom[current];
+        if (dir == SEARCH_ORIGIN) break;
+        current -= DIR_ROW[dir] * maze.getCols() + DIR_COL[dir];
+    }
+    std::reverse(path.begin(), path.end());
+    return path;
+}
+
+// Searches from both ends at once, the player side on the calling thread and the exit side on a second one.
+// Every cell has two bits in a shared atomic bitset (even bit for the player side, odd bit for the exit side),
+// so the single fetch_or that marks a cell also tells whether the other side got there first. The maze may
+// have cycles (the exit passage, changed walls), so the first meeting is not necessarily on a shortest path:
+// each meeting's length is measured by walking the other side's parents, and both sides keep going level by
+// level until no shorter meeting is possible. Once each side has expanded every cell up to depth c, every path
+// of length at most c0 + c1 + 2 has a cell marked by both sides, so the search stops when the best meeting is
+// no longer than that plus one. A side that runs out of cells without reaching the other origin proves the two
+// are not connected, which stops both sides at once.
+std::vector<int> Solver::bidirectionalBfs(int from, int to) {
+    const size_t count = maze.getCells().size();
+    const size_t words = (2 * count + 63) / 64;
+    std::unique_ptr<std::atomic<uint64_t>[]> visited(new std::atomic<uint64_t>[words]());
+    std::vector<uint8_t> cameFrom[2] = { std::vector<uint8_t>(count, UNVISITED), std::vector<uint8_t>(count, UNVISITED) };
+    std::atomic<int64_t> completed[2];
+    completed[0] = completed[1] = -1; // Deepest level each side has fully expanded
+    std::mutex bestMutex;
+    std::atomic<int64_t> bestLength(std::numeric_limits<int64_t>::max());
+    int meet = -1; // Guarded by bestMutex
+    std::atomic<bool> unreachable(false);
+    size_t sideExplored[2] = { 0, 0 };
+
+    // Steps from a cell back to a side's origin along its parents
+    auto depth = [&](int side, int cell) {
+        int64_t steps = 0;
+        for (int dir = cameFrom[side][cell]; dir != SEARCH_ORIGIN; dir = cameFrom[side][cell], ++steps) {
+            cell -= DIR_ROW[dir] * maze.getCols() + DIR_COL[dir];
+        }
+        return steps;
+    };
+    auto finished = [&]() {
+        return unreachable.load() || bestLength.load() <= completed[0].load() + completed[1].load() + 3;
+    };
+
+    auto expand = [&](int side, int origin, int target) {
+        std::vector<uint8_t>& parents = cameFrom[side];
+        std::vector<int> queue;
+
+        // Marks a cell at the given depth for this side, recording the path through it if the other side has it
+        auto visit = [&](int cell, uint8_t dir, int64_t cellDepth) {
+            parents[cell] = dir;
+            queue.push_back(cell);
+            size_t bit = 2 * static_cast<size_t>(cell);
+            uint64_t previous = visited[bit / 64].fetch_or(1ull << (bit % 64 + side));
+            if (previous & (1ull << (bit % 64 + 1 - side))) {
+                int64_t length = cellDepth + depth(1 - side, cell);
+                std::lock_guard<std::mutex> lock(bestMutex);
+                if (length < bestLength.load()) {
+                    bestLength = length;
+                    meet = cell;
+                }
+            }
+        };
+
+        visit(origin, SEARCH_ORIGIN, 0);
+        size_t head = 0;
+        size_t levelEnd = queue.size();
+        int64_t level = 0;
+        while (head < queue.size() && !finished()) {
+            int current = queue[head++];
+            for (int dir = 0; dir < 4; ++dir) {
+                int next = neighbor(current, dir);
+                if (next >= 0 && parents[next] == UNVISITED) {
+                    visit(next, static_cast<uint8_t>(dir), level + 1);
+                }
+            }
+            if (head == levelEnd) {
+                completed[side] = level++;
+                levelEnd = queue.size();
+            }
+        }
+        // A side that ran out of cells has seen its whole component, so the other side needs no more levels once
+        // a meeting is found, and none at all if the component does not hold the other origin
+        if (head == queue.size()) {
+            completed[side] = std::numeric_limits<int32_t>::max();
+            if (parents[target] == UNVISITED) {
+                unreachable = true;
+            }
+        }
+        sideExplored[side] = queue.size();
+    };
+
+    std::thread exitSide(expand, 1, to, from);
+    expand(0, from, to);
+    exitSide.join();
+    explored = sideExplored[0] + sideExplored[1];
+
+    std::vector<int> path;
+    if (meet < 0) return path;
+
+    // Player side: walk back from the meeting cell to the start, then flip
+    for (int current = meet; ; ) {
+        path.push_back(current);
+        int dir = cameFrom[0][current];
+        if (dir == SEARCH_ORIGIN) break;
+        current -= DIR_ROW[dir] * maze.getCols() + DIR_COL[dir];
+    }
+    std::reverse(path.begin(), path.end());
+
+    // Exit side: the same walk leads from the meeting cell towards the exit
+    for (int current = meet; cameFrom[1][current] != SEARCH_ORIGIN; ) {
+        int dir = cameFrom[1][current];
+        current -= DIR_ROW[dir] * maze.getCols() + DIR_COL[dir];
+        path.push_back(current);
+    }
+    return path;
+}
+
+const uint32_t INFINITE_DISTANCE = 0xFFFFFFFF;
+
+// Most checkpoints the tour planner solves exactly; its table takes 2^n * n * 4 bytes, 80 MB at 20
+const int MAX_TOUR_CHECKPOINTS = 20;
+
+uint32_t PathHint::heuristic(int a, int b) const {
+    int cols = maze.getCols();
+    return static_cast<uint32_t>(std::abs(a / cols - b / cols) + std::abs(a % cols - b % cols));
+}
+
+PathHint::Key PathHint::calculateKey(int cell) const {
+    uint32_t best = std::min(g[cell], rhs[cell]);
+    if (best == INFINITE_DISTANCE) return Key(INFINITE_DISTANCE, INFINITE_DISTANCE);
+    return Key(best + heuristic(start, cell) + km, best);
+}
+
+// Drops queue entries that were superseded by a later update and returns the smallest live key
+bool PathHint::topKey(Key& key) {
+    while (!open.empty()) {
+        const Entry& top = open.top();
+        if (queued[top.second] && queuedKey[top.second] == top.first) {
+            key = top.first;
+            return true;
+        }
+        open.pop();
+    }
+    return false;
+}
+
+void PathHint::updateVertex(int cell) {
+    if (cell != goal) {
+        uint32_t best = INFINITE_DISTANCE;
+        int row = cell / maze.getCols();
+        int col = cell % maze.getCols();
+        for (int dir = 0; dir < 4; ++dir) {
+            int nextRow = row + DIR_ROW[dir];
+            int nextCol = col + DIR_COL[dir];
+            if (nextRow < 0 || nextRow >= maze.getRows() || nextCol < 0 || nextCol >= maze.getCols() || maze.isWall(row, col, dir)) continue;
+            uint32_t distance = g[maze.getIndex(nextRow, nextCol)];
+            if (distance != INFINITE_DISTANCE) best = std::min(best, distance + 1);
+        }
+        rhs[cell] = best;
+    }
+
+    queued[cell] = g[cell] != rhs[cell];
+    if (queued[cell]) {
+        queuedKey[cell] = calculateKey(cell);
+        open.push(Entry(queuedKey[cell], cell));
+    }
+}
+
+void PathHint::computeShortestPath() {
+    Key top;
+    while (topKey(top) && (top < calculateKey(start) || rhs[start] != g[start])) {
+        int cell = open.top().second;
+        open.pop();
+        queued[cell] = false;
+
+        Key current = calculateKey(cell);
+        if (top < current) {
+            queued[cell] = true;
+            queuedKey[cell] = current;
+            open.push(Entry(current, cell));
+            continue;
+        }
+
+        bool overconsistent = g[cell] > rhs[cell];
+        g[cell] = overconsistent ? rhs[cell] : INFINITE_DISTANCE;
+        if (!overconsistent) updateVertex(cell);
+
+        int row = cell / maze.getCols();
+        int col = cell % maze.getCols();
+        for (int dir = 0; dir < 4; ++dir) {
+            int nextRow = row + DIR_ROW[dir];
+            int nextCol = col + DIR_COL[dir];
+            if (nextRow < 0 || nextRow >= maze.getRows() || nextCol < 0 || nextCol >= maze.getCols() || maze.isWall(row, col, dir)) continue;
+            updateVertex(maze.getIndex(nextRow, nextCol));
+        }
+    }
+    extractPath();
+}
+
+// Follows the smallest g values from the player to the exit
+void PathHint::extractPath() {
+    std::vector<int> route;
+    if (g[start] != INFINITE_DISTANCE) {
+        for (int cell = start; ; ) {
+            route.push_back(cell);
+            if (cell == goal) break;
+            int row = cell / maze.getCols();
+            int col = cell % maze.getCols();
+            int best = -1;
+            for (int dir = 0; dir < 4; ++dir) {
+                int nextRow = row + DIR_ROW[dir];
+                int nextCol = col + DIR_COL[dir];
+                if (nextRow < 0 || nextRow >= maze.getRows() || nextCol < 0 || nextCol >= maze.getCols() || maze.isWall(row, col, dir)) continue;
+                int next = maze.getIndex(nextRow, nextCol);
+                if (g[next] != INFINITE_DISTANCE && (best < 0 || g[next] < g[best])) {
+                    best = next;
+                }
+            }
+            if (best < 0 || route.size() > g.size()) {
+                route.clear();
+                break;
+            }
+            cell = best;
+        }
+    }
+    std::reverse(route.begin(), route.end());
+
+    // Only the quads after the first changed cell have to be rewritten
+    size_t same = 0;
+    while (same < route.size() && same < path.size() && same < cleanQuads && route[same] == path[same]) ++same;
+    cleanQuads = same;
+    path.swap(route);
+}
+
+void PathHint::reset(int row, int col) {
+    const size_t count = maze.getCells().size();
+    g.assign(count, INFINITE_DISTANCE);
+    rhs.assign(count, INFINITE_DISTANCE);
+    queuedKey.assign(count, Key());
+    queued.assign(count, false);
+    open = std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>>();
+    km = 0;
+    goal = maze.getExitIndex();
+    start = last = maze.getIndex(row, col);
+    cleanQuads = 0;
+
+    rhs[goal] = 0;
+    updateVertex(goal);
+    computeShortestPath();
+}
+
+void PathHint::moveStart(int row, int col) {
+    if (g.empty() || maze.getIndex(row, col) == start) return;
+    start = maze.getIndex(row, col);
+    km += heuristic(last, start);
+    last = start;
+    computeShortestPath();
+}
+
+void PathHint::wallChanged(int row, int col, int dir) {
+    if (g.empty()) return;
+    updateVertex(maze.getIndex(row, col));
+    int nextRow = row + DIR_ROW[dir];
+    int nextCol = col + DIR_COL[dir];
+    if (nextRow >= 0 && nextRow < maze.getRows() && nextCol >= 0 && nextCol < maze.getCols()) {
+        updateVertex(maze.getIndex(nextRow, nextCol));
+    }
+    computeShortestPath();
+}
+
+// Quads are in world units, so they stay valid whatever the view
+void PathHint::draw(sf::RenderWindow& window) {
+    geometry.resize(path.size() * 4);
+    const float size = 0.25f;
+    for (size_t i = cleanQuads; i < path.size(); ++i) {
+        float x = (path[i] % maze.getCols()) + 0.5f;
+        float y = (path[i] / maze.getCols()) + 0.5f;
+        sf::Vertex* quad = &geometry[i * 4];
+        quad[0] = sf::Vertex(sf::Vector2f(x - size, y - size), sf::Color(0, 200, 255, 160));
+        quad[1] = sf::Vertex(sf::Vector2f(x + size, y - size), sf::Color(0, 200, 255, 160));
+        quad[2] = sf::Vertex(sf::Vector2f(x + size, y + size), sf::Color(0, 200, 255, 160));
+        quad[3] = sf::Vertex(sf::Vector2f(x - size, y + size), sf::Color(0, 200, 255, 160));
+    }
+    cleanQuads = path.size();
+
+    countedDraw(window, geometry);
+}
+
+// Each reach is one more than the neighbour's on that side when the wall between them is open, found by one
+// sweep per direction
+void FogOfWar::build(const Maze& maze) {
+    const std::vector<Cell>& cells = maze.getCells();
+    int mazeRows = maze.getRows();
+    int mazeCols = maze.getCols();
+    sight.assign(cells.size(), Sight{ 0, 0, 0, 0 });
+    auto extend = [](uint16_t reach) { return static_cast<uint16_t>(std::min(reach + 1, 0xFFFF)); };
+    for (int i = 0; i < static_cast<int>(cells.size()); ++i) {
+        if (cells[i].col > 0 && !cells[i].walls[3]) sight[i].left = extend(sight[i - 1].left);
+        if (cells[i].row > 0 && !cells[i].walls[0]) sight[i].up = extend(sight[i - mazeCols].up);
+    }
+    for (int i = static_cast<int>(cells.size()) - 1; i >= 0; --i) {
+        if (cells[i].col < mazeCols - 1 && !cells[i].walls[1]) sight[i].right = extend(sight[i + 1].right);
+        if (cells[i].row < mazeRows - 1 && !cells[i].walls[2]) sight[i].down = extend(sight[i + mazeCols].down);
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    rows = mazeRows;
+    cols = mazeCols;
+    explored.assign((cells.size() + 63) / 64, 0);
+    changed.clear();
+    ++builds;
+}
+
+void FogOfWar::reveal(int row, int col) {
+    const Sight& seen = sight[row * cols + col];
+    int left = col - seen.left;
+    int top = row - seen.up;
+    int width = seen.left + seen.right + 1;
+    int height = seen.up + seen.down + 1;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (markRun(row * cols + left, width, 1)) {
+        addChanged(sf::IntRect(left, row, width, 1));
+    }
+    if (markRun(top * cols + col, height, cols)) {
+        addChanged(sf::IntRect(col, top, 1, height));
+    }
+}
+
+// Sets count bits stride apart from bit first, a whole word at a time along a row; returns whether any was new
+bool FogOfWar::markRun(int first, int count, int stride) {
+    uint64_t added = 0;
+    if (stride == 1) {
+        size_t bit = first;
+        size_t end = bit + count;
+        while (bit < end) {
+            size_t word = bit / 64;
+            size_t to = std::min(end, (word + 1) * 64);
+            uint64_t mask = (to - bit == 64 ? ~0ULL : (1ULL << (to - bit)) - 1) << (bit % 64);
+            added |= mask & ~explored[word];
+            explored[word] |= mask;
+            bit = to;
+        }
+    }
+    else {
+        for (size_t bit = first, i = 0; i < static_cast<size_t>(count); ++i, bit += stride) {
+            uint64_t mask = 1ULL << (bit % 64);
+            added |= mask & ~explored[bit / 64];
+            explored[bit / 64] |= mask;
+        }
+    }
+    return added != 0;
+}
+
+// Queues a changed run. Should the render thread fall far behind, the queue collapses into its bounding box.
+void FogOfWar::addChanged(const sf::IntRect& area) {
+    changed.push_back(area);
+    if (changed.size() <= MAX_FOG_CHANGES) return;
+
+    sf::IntRect bounds = changed[0];
+    for (const sf::IntRect& run : changed) {
+        int right = std::max(bounds.left + bounds.width, run.left + run.width);
+        int bottom = std::max(bounds.top + bounds.height, run.top + run.height);
+        bounds.left = std::min(bounds.left, run.left);
+        bounds.top = std::min(bounds.top, run.top);
+        bounds.width = right - bounds.left;
+        bounds.height = bottom - bounds.top;
+    }
+    changed.assign(1, bounds);
+}
+
+bool FogOfWar::isExplored(int row, int col) const {
+    size_t bit = static_cast<size_t>(row) * cols + col;
+    return (explored[bit / 64] >> (bit % 64)) & 1;
+}
+
+// Brings the textures up to date with the cells explored since the last refresh, or all of them after a build.
+// Called once per frame before drawing.
+void FogOfWar::refresh() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (builds == 0) return;
+
+    refreshing.swap(changed);
+    changed.clear();
+    if (drawnBuilds != builds) {
+        tilesPerRow = (cols + PYRAMID_TILE_SIZE - 1) / PYRAMID_TILE_SIZE;
+        int tileRows = (rows + PYRAMID_TILE_SIZE - 1) / PYRAMID_TILE_SIZE;
+        tiles.resize(covering ? tilesPerRow * tileRows : 0);
+        for (size_t i = 0; i < tiles.size(); ++i) {
+            int width = std::min<int>(PYRAMID_TILE_SIZE, cols - static_cast<int>(i % tilesPerRow) * PYRAMID_TILE_SIZE);
+            int height = std::min<int>(PYRAMID_TILE_SIZE, rows - static_cast<int>(i / tilesPerRow) * PYRAMID_TILE_SIZE);
+            if (!tiles[i].create(width, height)) {
+                std::cerr << "Error creating fog texture\n";
+            }
+        }
+        minimapBlock = std::max(1, (std::max(rows, cols) + MINIMAP_TEXELS - 1) / MINIMAP_TEXELS);
+        if (!minimap.create((cols + minimapBlock - 1) / minimapBlock, (rows + minimapBlock - 1) / minimapBlock + 1)) {
+            std::cerr << "Error creating minimap texture\n";
+        }
+        const sf::Uint8 player[4] = { 0, 255, 0, 255 };
+        minimap.update(player, 1, 1, 0, minimap.getSize().y - 1);
+        refreshing.assign(1, sf::IntRect(0, 0, cols, rows));
+        drawnBuilds = builds;
+        drawnSize = sf::Vector2i(cols, rows);
+    }
+
+    for (const sf::IntRect& area : refreshing) {
+        updateTextures(area);
+    }
+}
+
+// Copies one rectangle of cells into the fog tiles it overlaps and the minimap blocks it touches
+void FogOfWar::updateTextures(const sf::IntRect& area) {
+    for (size_t i = 0; i < tiles.size(); ++i) {
+        sf::IntRect tileArea(static_cast<int>(i % tilesPerRow) * PYRAMID_TILE_SIZE, static_cast<int>(i / tilesPerRow) * PYRAMID_TILE_SIZE,
+            tiles[i].getSize().x, tiles[i].getSize().y);
+        sf::IntRect update;
+        if (!area.intersects(tileArea, update)) continue;
+        texels.resize(static_cast<size_t>(update.width) * update.height * 4);
+        sf::Uint8* texel = texels.data();
+        for (int y = update.top; y < update.top + update.height; ++y) {
+            for (int x = update.left; x < update.left + update.width; ++x, texel += 4) {
+                texel[0] = texel[1] = texel[2] = 0;
+                texel[3] = isExplored(y, x) ? 0 : 255;
+            }
+        }
+        tiles[i].update(texels.data(), update.width, update.height, update.left - tileArea.left, update.top - tileArea.top);
+    }
+
+    // A block is explored once any of its cells is; only the blocks the changed cells fall in are repainted
+    int left = area.left / minimapBlock;
+    int top = area.top / minimapBlock;
+    int right = (area.left + area.width - 1) / minimapBlock;
+    int bottom = (area.top + area.height - 1) / minimapBlock;
+    texels.resize(static_cast<size_t>(right - left + 1) * (bottom - top + 1) * 4);
+    sf::Uint8* texel = texels.data();
+    for (int by = top; by <= bottom; ++by) {
+        for (int bx = left; bx <= right; ++bx, texel += 4) {
+            bool seen = false;
+            for (int y = by * minimapBlock; y < std::min(rows, (by + 1) * minimapBlock) && !seen; ++y) {
+                for (int x = bx * minimapBlock; x < std::min(cols, (bx + 1) * minimapBlock) && !seen; ++x) {
+                    seen = isExplored(y, x);
+                }
+            }
+            sf::Color color = seen ? sf::Color(200, 200, 200) : sf::Color(40, 40, 40, 200);
+            texel[0] = color.r;
+            texel[1] = color.g;
+            texel[2] = color.b;
+            texel[3] = color.a;
+        }
+    }
+    minimap.update(texels.data(), right - left + 1, bottom - top + 1, left, top);
+}
+
+// Draws the fog tiles in view over the maze, in world units
+void FogOfWar::draw(sf::RenderTarget& target) {
+    const sf::View& view = target.getView();
+    sf::FloatRect visible(view.getCenter() - view.getSize() / 2.0f, view.getSize());
+    for (size_t i = 0; i < tiles.size(); ++i) {
+        sf::Sprite sprite(tiles[i]);
+        sprite.setPosition(static_cast<float>(i % tilesPerRow * PYRAMID_TILE_SIZE), static_cast<float>(i / tilesPerRow * PYRAMID_TILE_SIZE));
+        if (sprite.getGlobalBounds().intersects(visible)) {
+            countedDraw(target, sprite);
+        }
+    }
+}
+
+// Draws the minimap in the top-right corner of the target's default view, with the player at position (in
+// cells). The map and the player are two quads textured from the minimap texture, so one draw call; the
+// player's quad samples the single texel of the texture's last row.
+void FogOfWar::drawMinimap(sf::RenderTarget& target, sf::Vector2f player) {
+    if (drawnBuilds == 0) return;
+    float scale = MINIMAP_SIZE / std::max(drawnSize.x, drawnSize.y);
+    sf::Vector2f size(drawnSize.x * scale, drawnSize.y * scale);
+    sf::Vector2f origin(target.getSize().x - size.x - BORDER_SIZE, static_cast<float>(BORDER_SIZE));
+    sf::Vector2f texture(static_cast<float>(drawnSize.x) / minimapBlock, static_cast<float>(drawnSize.y) / minimapBlock);
+    minimapQuads[0] = sf::Vertex(origin, sf::Vector2f(0, 0));
+    minimapQuads[1] = sf::Vertex(origin + sf::Vector2f(size.x, 0), sf::Vector2f(texture.x, 0));
+    minimapQuads[2] = sf::Vertex(origin + size, texture);
+    minimapQuads[3] = sf::Vertex(origin + sf::Vector2f(0, size.y), sf::Vector2f(0, texture.y));
+
+    float half = std::max(1.5f, scale / 2);
+    sf::Vector2f center = origin + (player + sf::Vector2f(0.5f, 0.5f)) * scale;
+    sf::Vector2f texel(0.5f, minimap.getSize().y - 0.5f);
+    minimapQuads[4] = sf::Vertex(center + sf::Vector2f(-half, -half), texel);
+    minimapQuads[5] = sf::Vertex(center + sf::Vector2f(half, -half), texel);
+    minimapQuads[6] = sf::Vertex(center + sf::Vector2f(half, half), texel);
+    minimapQuads[7] = sf::Vertex(center + sf::Vector2f(-half, half), texel);
+    countedDraw(target, minimapQuads, sf::RenderStates(&minimap));
+}
+
+// BFS from one cell that stops as soon as every target has been reached
+std::vector<uint32_t> TourPlanner::distancesFrom(int source, const std::vector<int>& targets) const {
+    std::vector<uint32_t> distance(maze.getCells().size(), INFINITE_DISTANCE);
+    std::vector<int> queue;
+    queue.push_back(source);
+    distance[source] = 0;
+
+    size_t remaining = 0;
+    for (int target : targets) {
+        if (target != source) ++remaining;
+    }
+
+    size_t head = 0;
+    while (head < queue.size() && remaining > 0) {
+        int cell = queue[head++];
+        int row = cell / maze.getCols();
+        int col = cell % maze.getCols();
+        for (int dir = 0; dir < 4; ++dir) {
+            int nextRow = row + DIR_ROW[dir];
+            int nextCol = col + DIR_COL[dir];
+            if (nextRow < 0 || nextRow >= maze.getRows() || nextCol < 0 || nextCol >= maze.getCols() || maze.isWall(row, col, dir)) continue;
+            int next = maze.getIndex(nextRow, nextCol);
+            if (distance[next] != INFINITE_DISTANCE) continue;
+            distance[next] = distance[cell] + 1;
+            queue.push_back(next);
+            if (std::find(targets.begin(), targets.end(), next) != targets.end()) --remaining;
+        }
+    }
+
+    std::vector<uint32_t> result;
+    for (int target : targets) {
+        result.push_back(distance[target]);
+    }
+    return result;
+}
+
+// Goes from the start to the nearest unvisited checkpoint each time, then to the exit. distance is indexed as
+// in plan: the checkpoints, then the start, then the exit.
+uint32_t TourPlanner::planGreedy(const std::vector<std::vector<uint32_t>>& distance, int n) {
+    std::vector<bool> visited(n, false);
+    uint32_t total = 0;
+    int current = n;
+    for (int step = 0; step < n; ++step) {
+        int nearest = -1;
+        for (int j = 0; j < n; ++j) {
+            if (!visited[j] && (nearest < 0 || distance[current][j] < distance[current][nearest])) {
+                nearest = j;
+            }
+        }
+        if (distance[current][nearest] == INFINITE_DISTANCE) {
+            order.clear();
+            return INFINITE_DISTANCE;
+        }
+        total += distance[current][nearest];
+        visited[nearest] = true;
+        order.push_back(nearest);
+        current = nearest;
+    }
+    if (distance[current][n + 1] == INFINITE_DISTANCE) {
+        order.clear();
+        return INFINITE_DISTANCE;
+    }
+    return total + distance[current][n + 1];
+}
+
+uint32_t TourPlanner::plan(int start, const std::vector<int>& checkpoints, int exit) {
+    const int n = static_cast<int>(checkpoints.size());
+    const unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+    order.clear();
+
+    // Points are the checkpoints, then the start, then the exit
+    std::vector<int> points = checkpoints;
+    points.push_back(start);
+    points.push_back(exit);
+    std::vector<std::vector<uint32_t>> distance(points.size());
+    {
+        // Field lookups come first, on this thread, since the first one builds the fields
+        const std::vector<std::pair<int, int>>& mazeCheckpoints = maze.getCheckpointPositions();
+        std::vector<size_t> searched;
+        for (size_t i = 0; i < points.size(); ++i) {
+            auto found = std::find(mazeCheckpoints.begin(), mazeCheckpoints.end(),
+                std::make_pair(points[i] / maze.getCols(), points[i] % maze.getCols()));
+            if (points[i] != maze.getExitIndex() && found == mazeCheckpoints.end()) {
+                searched.push_back(i);
+                continue;
+            }
+            for (int target : points) {
+                int row = target / maze.getCols();
+                int col = target % maze.getCols();
+                distance[i].push_back(points[i] == maze.getExitIndex() ? maze.distanceToExit(row, col)
+                    : maze.distanceToCheckpoint(static_cast<int>(found - mazeCheckpoints.begin()), row, col));
+            }
+        }
+
+        std::atomic<size_t> nextSource(0);
+        auto worker = [&]() {
+            for (size_t i = nextSource++; i < searched.size(); i = nextSource++) {
+                distance[searched[i]] = distancesFrom(points[searched[i]], points);
+            }
+        };
+        std::vector<std::thread> pool;
+        for (size_t t = 1; t < std::min<size_t>(threads, searched.size()); ++t) pool.emplace_back(worker);
+        worker();
+        for (auto& thread : pool) thread.join();
+    }
+    const int startPoint = n;
+    const int exitPoint = n + 1;
+    auto add = [](uint32_t a, uint32_t b) {
+        return (a == INFINITE_DISTANCE || b == INFINITE_DISTANCE) ? INFINITE_DISTANCE : a + b;
+    };
+
+    if (n == 0) return distance[startPoint][exitPoint];
+    if (n > MAX_TOUR_CHECKPOINTS) {
+        std::cerr << n << " checkpoints are too many to plan an exact tour (at most " << MAX_TOUR_CHECKPOINTS
+            << "), using the nearest-neighbour order\n";
+        return planGreedy(distance, n);
+    }
+
+    // best[mask * n + j]: shortest walk from the start through exactly the checkpoints in mask, ending at j
+    const size_t masks = size_t(1) << n;
+    std::vector<uint32_t> best(masks * n, INFINITE_DISTANCE);
+    for (int j = 0; j < n; ++j) {
+        best[(size_t(1) << j) * n + j] = distance[startPoint][j];
+    }
+
+    // Subsets of the same size only read from the previous size, so each layer is split across threads
+    std::vector<std::vector<uint32_t>> layers(n + 1);
+    for (size_t mask = 1; mask < masks; ++mask) {
+        int bits = 0;
+        for (size_t m = mask; m != 0; m &= m - 1) ++bits;
+        if (bits >= 2) layers[bits].push_back(static_cast<uint32_t>(mask));
+    }
+    for (int size = 2; size <= n; ++size) {
+        const std::vector<uint32_t>& layer = layers[size];
+        auto worker = [&](size_t begin, size_t end) {
+            for (size_t m = begin; m < end; ++m) {
+                size_t mask = layer[m];
+                for (int j = 0; j < n; ++j) {
+                    if (!(mask & (size_t(1) << j))) continue;
+                    size_t previous = mask ^ (size_t(1) << j);
+                    uint32_t shortest = INFINITE_DISTANCE;
+                    for (int i = 0; i < n; ++i) {
+                        if (previous & (size_t(1) << i)) {
+                            shortest = std::min(shortest, add(best[previous * n + i], distance[i][j]));
+                        }
+                    }
+                    best[mask * n + j] = shortest;
+                }
+            }
+        };
+        size_t chunk = (layer.size() + threads - 1) / threads;
+        std::vector<std::thread> pool;
+        for (size_t begin = chunk; begin < layer.size(); begin += chunk) {
+            pool.emplace_back(worker, begin, std::min(layer.size(), begin + chunk));
+        }
+        worker(0, std::min(layer.size(), chunk));
+        for (auto& thread : pool) thread.join();
+    }
+
+    const size_t full = masks - 1;
+    uint32_t total = INFINITE_DISTANCE;
+    int last = -1;
+    for (int j = 0; j < n; ++j) {
+        uint32_t length = add(best[full * n + j], distance[j][exitPoint]);
+        if (length < total) {
+            total = length;
+            last = j;
+        }
+    }
+    if (last < 0) return INFINITE_DISTANCE;
+
+    // Walk the table back from the last checkpoint
+    for (size_t mask = full; last >= 0; ) {
+        order.push_back(last);
+        size_t previous = mask ^ (size_t(1) << last);
+        int before = -1;
+        for (int i = 0; i < n && previous != 0; ++i) {
+            if ((previous & (size_t(1) << i)) && add(best[previous * n + i], distance[i][last]) == best[mask * n + last]) {
+                before = i;
+                break;
+            }
+        }
+        mask = previous;
+        last = before;
+    }
+    std::reverse(order.begin(), order.end());
+    return total;
+}
+
+int StreamSolver::createNode() {
+    int node;
+    if (!freeNodes.empty()) {
+        node = freeNodes.back();
+        freeNodes.pop_back();
+    }
+    else {
+        node = static_cast<int>(nodes.size());
+        nodes.emplace_back();
+    }
+    nodes[node].alive = true;
+    nodes[node].terminal = true;
+    nodes[node].edges.clear();
+    peakNodes = std::max(peakNodes, ++liveNodes);
+    return node;
+}
+
+void StreamSolver::removeEdge(int from, int to) {
+    auto& edges = nodes[from].edges;
+    for (size_t i = 0; i < edges.size(); ++i) {
+        if (edges[i].first == to) {
+            edges[i] = edges.back();
+            edges.pop_back();
+            return;
+        }
+    }
+}
+
+// Parallel edges keep only the shorter length
+void StreamSolver::addEdge(int a, int b, uint64_t length) {
+    for (auto& edge : nodes[a].edges) {
+        if (edge.first == b) {
+            if (length < edge.second) {
+                edge.second = length;
+                for (auto& back : nodes[b].edges) {
+                    if (back.first == a) back.second = length;
+                }
+            }
+            return;
+        }
+    }
+    nodes[a].edges.push_back({ b, length });
+    nodes[b].edges.push_back({ a, length });
+}
+
+// Removes non-terminal nodes that cannot matter to a shortest path: isolated ones and dead ends are dropped,
+// and a node with two neighbours becomes a single edge between them. Neighbours are rechecked afterwards.
+void StreamSolver::contract(int node) {
+    pending.push_back(node);
+    while (!pending.empty()) {
+        int current = pending.back();
+        pending.pop_back();
+        Node& n = nodes[current];
+        if (!n.alive || n.terminal || n.edges.size() > 2) continue;
+
+        std::vector<std::pair<int, uint64_t>> edges;
+        edges.swap(n.edges);
+        n.alive = false;
+        freeNodes.push_back(current);
+        --liveNodes;
+
+        for (const auto& edge : edges) {
+            removeEdge(edge.first, current);
+            pending.push_back(edge.first);
+        }
+        if (edges.size() == 2) {
+            addEdge(edges[0].first, edges[1].first, edges[0].second + edges[1].second);
+        }
+    }
+}
+
+uint64_t StreamSolver::shortestDistance(int from, int to) const {
+    const uint64_t unreached = ~uint64_t(0);
+    std::vector<uint64_t> distance(nodes.size(), unreached);
+    std::priority_queue<std::pair<uint64_t, int>, std::vector<std::pair<uint64_t, int>>, std::greater<std::pair<uint64_t, int>>> open;
+    distance[from] = 0;
+    open.push({ 0, from });
+    while (!open.empty()) {
+        std::pair<uint64_t, int> top = open.top();
+        open.pop();
+        if (top.first != distance[top.second]) continue;
+        if (top.second == to) break;
+        for (const auto& edge : nodes[top.second].edges) {
+            if (top.first + edge.second < distance[edge.first]) {
+                distance[edge.first] = top.first + edge.second;
+                open.push({ distance[edge.first], edge.first });
+            }
+        }
+    }
+    return distance[to];
+}
+
+bool StreamSolver::solve(std::istream& in) {
+    std::string magic;
+    if (!(in >> magic >> rows >> cols) || magic != "MAZE" || rows <= 0 || cols <= 0) return false;
+    in.get();
+
+    nodes.clear();
+    freeNodes.clear();
+    liveNodes = peakNodes = 0;
+    reachable = false;
+    pathLength = 0;
+
+    std::vector<char> previousWalls(cols), walls(cols);
+    std::vector<int> previousRow(cols, -1), currentRow(cols, -1);
+    int start = -1, exit = -1;
+
+    for (int row = 0; row < rows; ++row) {
+        if (!in.read(walls.data(), cols)) return false;
+
+        for (int col = 0; col < cols; ++col) {
+            currentRow[col] = createNode();
+            if (col > 0 && !(walls[col - 1] & 2)) {
+                addEdge(currentRow[col - 1], currentRow[col], 1);
+            }
+            if (row > 0 && !(previousWalls[col] & 4)) {
+                addEdge(previousRow[col], currentRow[col], 1);
+            }
+        }
+        if (row == 0) start = currentRow[0];
+        if (row == rows - 1) exit = currentRow[cols - 1];
+
+        // The previous row is now behind the frontier
+        if (row > 0) {
+            for (int col = 0; col < cols; ++col) {
+                if (previousRow[col] != start) nodes[previousRow[col]].terminal = false;
+            }
+            for (int col = 0; col < cols; ++col) {
+                contract(previousRow[col]);
+            }
+        }
+        previousRow.swap(currentRow);
+        previousWalls.swap(walls);
+    }
+
+    uint64_t distance = shortestDistance(start, exit);
+    reachable = distance != ~uint64_t(0);
+    pathLength = reachable ? distance : 0;
+    return true;
+}
+
+// Pixels are stored as R, G, B, A bytes in memory whatever the byte order of the machine
+uint32_t packColor(const sf::Color& color) {
+    uint8_t bytes[4] = { color.r, color.g, color.b, color.a };
+    uint32_t pixel;
+    std::memcpy(&pixel, bytes, 4);
+    return pixel;
+}
+
+// Fills pixels [from, to) of a row, four at a time with SSE2 when the target has it
+void fillSpan(uint32_t* row, int from, int to, uint32_t color) {
+    int x = from;
+#ifdef MAZE_SSE2
+    __m128i quad = _mm_set1_epi32(static_cast<int>(color));
+    for (; x + 4 <= to; x += 4) {
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(row + x), quad);
+    }
+#endif
+    for (; x < to; ++x) {
+        row[x] = color;
+    }
+}
+
+// Paints in the same order as the vertex geometry: for each cell its top, right and left walls, then its
+// markers. Bottom walls lie on the first pixel row of the cell below, so they are painted before that row.
+void SoftwareRasterizer::renderRows(int first, int count, uint32_t* pixels) const {
+    if (cellsPerPixel > 0) {
+        renderReduced(first, count, pixels);
+        return;
+    }
+    const int width = getWidth();
+    const int cols = maze.getCols();
+    const uint32_t black = packColor(sf::Color::Black);
+    const uint32_t white = packColor(sf::Color::White);
+    const uint32_t red = packColor(sf::Color::Red);
+    const uint32_t yellow = packColor(sf::Color::Yellow);
+    const std::vector<Cell>& cells = maze.getCells();
+
+    for (int y = first; y < first + count; ++y) {
+        uint32_t* row = pixels + static_cast<size_t>(y - first) * width;
+        fillSpan(row, 0, width, black);
+
+        int cellRow = y / cellSize;
+        int offset = y % cellSize;
+        if (offset == 0 && cellRow > 0) {
+            for (int col = 0; col < cols; ++col) {
+                if (cells[maze.getIndex(cellRow - 1, col)].walls[2]) {
+                    fillSpan(row, col * cellSize, (col + 1) * cellSize, white);
+                }
+            }
+        }
+        if (cellRow >= maze.getRows()) continue;
+
+        for (int col = 0; col < cols; ++col) {
+            int index = maze.getIndex(cellRow, col);
+            const Cell& cell = cells[index];
+            int x = col * cellSize;
+            if (offset == 0 && cell.walls[0]) fillSpan(row, x, x + cellSize, white);
+            if (cell.walls[1]) row[x + cellSize] = white;
+            if (cell.walls[3]) row[x] = white;
+            if (index == maze.getExitIndex()) fillSpan(row, x, x + cellSize, red);
+            if (cell.checkpoint) fillSpan(row, x, x + cellSize, yellow);
+        }
+    }
+}
+
+// Box filter: each pixel averages the shades of the cells under it, fewer along the right and bottom edges
+void SoftwareRasterizer::renderReduced(int first, int count, uint32_t* pixels) const {
+    const int width = getWidth();
+    std::vector<uint32_t> sums(static_cast<size_t>(width) * 3);
+    std::vector<uint32_t> counts(width);
+    for (int y = first; y < first + count; ++y) {
+        std::fill(sums.begin(), sums.end(), 0);
+        std::fill(counts.begin(), counts.end(), 0);
+        for (int row = y * cellsPerPixel; row < std::min(maze.getRows(), (y + 1) * cellsPerPixel); ++row) {
+            for (int col = 0; col < maze.getCols(); ++col) {
+                sf::Color shade = getCellShade(maze, maze.getIndex(row, col));
+                int x = col / cellsPerPixel;
+                sums[x * 3] += shade.r;
+                sums[x * 3 + 1] += shade.g;
+                sums[x * 3 + 2] += shade.b;
+                ++counts[x];
+            }
+        }
+        uint32_t* out = pixels + static_cast<size_t>(y - first) * width;
+        for (int x = 0; x < width; ++x) {
+            out[x] = packColor(sf::Color(static_cast<sf::Uint8>(sums[x * 3] / counts[x]),
+                static_cast<sf::Uint8>(sums[x * 3 + 1] / counts[x]), static_cast<sf::Uint8>(sums[x * 3 + 2] / counts[x])));
+        }
+    }
+}
+
+void SoftwareRasterizer::render(std::vector<uint32_t>& pixels) const {
+    pixels.resize(static_cast<size_t>(getWidth()) * getHeight());
+    renderRows(0, getHeight(), pixels.data());
+}
+
+// Rows rendered per band when writing images
+const int RASTER_BAND = 64;
+
+bool SoftwareRasterizer::savePpm(const std::string& path) const {
+    std::ofstream out(path, std::ios::binary);
+    out << "P6\n" << getWidth() << " " << getHeight() << "\n255\n";
+
+    std::vector<uint32_t> band(static_cast<size_t>(getWidth()) * RASTER_BAND);
+    std::vector<char> rgb;
+    for (int y = 0; y < getHeight(); y += RASTER_BAND) {
+        int count = std::min(RASTER_BAND, getHeight() - y);
+        renderRows(y, count, band.data());
+        rgb.resize(static_cast<size_t>(getWidth()) * count * 3);
+        for (size_t i = 0; i < static_cast<size_t>(getWidth()) * count; ++i) {
+            std::memcpy(&rgb[i * 3], &band[i], 3);
+        }
+        out.write(rgb.data(), rgb.size());
+    }
+    return static_cast<bool>(out);
+}
+
+uint32_t crc32(const uint8_t* data, size_t size, uint32_t crc = 0) {
+    static uint32_t table[256];
+    static bool tableReady = false;
+    if (!tableReady) {
+        for (uint32_t n = 0; n < 256; ++n) {
+            uint32_t c = n;
+            for (int k = 0; k < 8; ++k) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            table[n] = c;
+        }
+        tableReady = true;
+    }
+    crc = ~crc;
+    for (size_t i = 0; i < size; ++i) crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+void writeChunk(std::ostream& out, const char* type, const std::vector<uint8_t>& data) {
+    uint8_t header[8] = {
+        static_cast<uint8_t>(data.size() >> 24), static_cast<uint8_t>(data.size() >> 16),
+        static_cast<uint8_t>(data.size() >> 8), static_cast<uint8_t>(data.size()),
+        static_cast<uint8_t>(type[0]), static_cast<uint8_t>(type[1]), static_cast<uint8_t>(type[2]), static_cast<uint8_t>(type[3]) };
+    uint32_t crc = crc32(header + 4, 4);
+    if (!data.empty()) crc = crc32(data.data(), data.size(), crc);
+    uint8_t trailer[4] = { static_cast<uint8_t>(crc >> 24), static_cast<uint8_t>(crc >> 16), static_cast<uint8_t>(crc >> 8), static_cast<uint8_t>(crc) };
+    out.write(reinterpret_cast<const char*>(header), 8);
+    out.write(reinterpret_cast<const char*>(data.data()), data.size());
+    out.write(reinterpret_cast<const char*>(trailer), 4);
+}
+
+// Lengths and distances of deflate's match codes, with their extra bits
+const uint16_t DEFLATE_LENGTH_BASE[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+const uint8_t DEFLATE_LENGTH_EXTRA[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+const uint16_t DEFLATE_DISTANCE_BASE[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537,
+    2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+const uint8_t DEFLATE_DISTANCE_EXTRA[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+const int DEFLATE_WINDOW = 32768;
+const int DEFLATE_HASH_BITS = 15;
+
+// Starts with the zlib header (deflate, 32 KB window) and the header of the one final fixed-Huffman block
+Deflater::Deflater(int maxChain) : maxChain(maxChain), head(1 << DEFLATE_HASH_BITS), previous(DEFLATE_WINDOW), bits(0x0178), bitCount(16) {
+    bits |= 0x3ULL << bitCount;
+    bitCount += 3;
+}
+
+void Deflater::putBits(uint32_t value, int count, std::vector<uint8_t>& out) {
+    bits |= static_cast<uint64_t>(value) << bitCount;
+    bitCount += count;
+    while (bitCount >= 8) {
+        out.push_back(static_cast<uint8_t>(bits));
+        bits >>= 8;
+        bitCount -= 8;
+    }
+}
+
+// Huffman codes go out from their most significant bit, everything else from the least
+void Deflater::putCode(uint32_t code, int length, std::vector<uint8_t>& out) {
+    uint32_t reversed = 0;
+    for (int i = 0; i < length; ++i) {
+        reversed = (reversed << 1) | ((code >> i) & 1);
+    }
+    putBits(reversed, length, out);
+}
+
+void Deflater::putSymbol(int symbol, std::vector<uint8_t>& out) {
+    if (symbol < 144) putCode(0x30 + symbol, 8, out);
+    else if (symbol < 256) putCode(0x190 + symbol - 144, 9, out);
+    else if (symbol < 280) putCode(symbol - 256, 7, out);
+    else putCode(0xC0 + symbol - 280, 8, out);
+}
+
+void Deflater::putMatch(int length, int distance, std::vector<uint8_t>& out) {
+    int code = 28;
+    while (DEFLATE_LENGTH_BASE[code] > length) --code;
+    putSymbol(257 + code, out);
+    putBits(length - DEFLATE_LENGTH_BASE[code], DEFLATE_LENGTH_EXTRA[code], out);
+    code = 29;
+    while (DEFLATE_DISTANCE_BASE[code] > distance) --code;
+    putCode(code, 5, out);
+    putBits(distance - DEFLATE_DISTANCE_BASE[code], DEFLATE_DISTANCE_EXTRA[code], out);
+}
+
+// Greedy matching: the longest match among the chain of earlier positions with the same first three bytes
+void Deflater::write(const uint8_t* data, size_t size, std::vector<uint8_t>& out) {
+    for (size_t i = 0; i < size; ++i) {
+        adlerA = (adlerA + data[i]) % 65521;
+        adlerB = (adlerB + adlerA) % 65521;
+    }
+
+    std::fill(head.begin(), head.end(), -1);
+    auto hash = [data](size_t pos) {
+        return ((data[pos] << 10) ^ (data[pos + 1] << 5) ^ data[pos + 2]) & ((1 << DEFLATE_HASH_BITS) - 1);
+    };
+    auto insert = [&](size_t pos) {
+        if (pos + 3 > size) return;
+        int h = hash(pos);
+        previous[pos % DEFLATE_WINDOW] = head[h];
+        head[h] = static_cast<int32_t>(pos);
+    };
+
+    size_t pos = 0;
+    while (pos < size) {
+        int bestLength = 0;
+        int bestDistance = 0;
+        if (pos + 3 <= size) {
+            const int limit = static_cast<int>(std::min<size_t>(258, size - pos));
+            int32_t candidate = head[hash(pos)];
+            for (int chain = 0; candidate >= 0 && pos - candidate <= DEFLATE_WINDOW && chain < maxChain; ++chain) {
+                const uint8_t* earlier = data + candidate;
+                const uint8_t* current = data + pos;
+                if (earlier[bestLength] == current[bestLength]) {
+                    int length = 0;
+                    while (length < limit && earlier[length] == current[length]) ++length;
+                    if (length > bestLength) {
+                        bestLength = length;
+                        bestDistance = static_cast<int>(pos - candidate);
+                        if (length == limit) break;
+                    }
+                }
+                // A slot overwritten by a later position no longer leads further back
+                int32_t next = previous[candidate % DEFLATE_WINDOW];
+                if (next >= candidate) break;
+                candidate = next;
+            }
+        }
+
+        if (bestLength >= 3) {
+            putMatch(bestLength, bestDistance, out);
+            for (int i = 0; i < bestLength; ++i) insert(pos + i);
+            pos += bestLength;
+        }
+        else {
+            putSymbol(data[pos], out);
+            insert(pos);
+            ++pos;
+        }
+    }
+}
+
+// Ends the block, pads to a byte and appends the Adler-32 of all the input
+void Deflater::finish(std::vector<uint8_t>& out) {
+    putSymbol(256, out);
+    if (bitCount > 0) putBits(0, 8 - bitCount, out);
+    uint32_t adler = (adlerB << 16) | adlerA;
+    out.push_back(static_cast<uint8_t>(adler >> 24));
+    out.push_back(static_cast<uint8_t>(adler >> 16));
+    out.push_back(static_cast<uint8_t>(adler >> 8));
+    out.push_back(static_cast<uint8_t>(adler));
+}
+
+// Earlier positions the PNG encoder tries for each match: still images can afford a longer search than frames
+// captured while the game runs
+const int PNG_MAX_CHAIN = 32;
+const int CAPTURE_MAX_CHAIN = 4;
+
+// Writes an 8-bit RGBA PNG, asking rows(first, count, pixels) for bands of up to RASTER_BAND rows. Every
+// scanline uses the Up filter, which turns rows repeated from the one above (most of a maze) into zeros, and
+// each band is compressed into its own IDAT chunk.
+bool writePng(const std::string& path, uint32_t width, uint32_t height, const std::function<void(int, int, uint32_t*)>& rows,
+    int maxChain = PNG_MAX_CHAIN) {
+    std::ofstream out(path, std::ios::binary);
+    const char signature[8] = { '\x89', 'P', 'N', 'G', '\r', '\n', '\x1A', '\n' };
+    out.write(signature, 8);
+
+    std::vector<uint8_t> header = {
+        static_cast<uint8_t>(width >> 24), static_cast<uint8_t>(width >> 16), static_cast<uint8_t>(width >> 8), static_cast<uint8_t>(width),
+        static_cast<uint8_t>(height >> 24), static_cast<uint8_t>(height >> 16), static_cast<uint8_t>(height >> 8), static_cast<uint8_t>(height),
+        8, 6, 0, 0, 0 };
+    writeChunk(out, "IHDR", header);
+
+    Deflater deflater(maxChain);
+    const size_t stride = static_cast<size_t>(width) * 4;
+    std::vector<uint32_t> band(static_cast<size_t>(width) * RASTER_BAND);
+    std::vector<uint8_t> above(stride, 0);
+    std::vector<uint8_t> raw, chunk;
+    for (uint32_t y = 0; y < height; y += RASTER_BAND) {
+        int count = std::min<int>(RASTER_BAND, height - y);
+        rows(y, count, band.data());
+
+        raw.resize((stride + 1) * count);
+        for (int r = 0; r < count; ++r) {
+            uint8_t* line = &raw[(stride + 1) * r];
+            const uint8_t* pixels = reinterpret_cast<const uint8_t*>(&band[static_cast<size_t>(r) * width]);
+            line[0] = 2; // Up
+            for (size_t i = 0; i < stride; ++i) {
+                line[i + 1] = static_cast<uint8_t>(pixels[i] - above[i]);
+            }
+            std::memcpy(above.data(), pixels, stride);
+        }
+
+        chunk.clear();
+        deflater.write(raw.data(), raw.size(), chunk);
+        writeChunk(out, "IDAT", chunk);
+    }
+
+    chunk.clear();
+    deflater.finish(chunk);
+    writeChunk(out, "IDAT", chunk);
+    writeChunk(out, "IEND", std::vector<uint8_t>());
+    return static_cast<bool>(out);
+}
+
+bool SoftwareRasterizer::savePng(const std::string& path) const {
+    return writePng(path, getWidth(), getHeight(), [this](int first, int count, uint32_t* pixels) {
+        renderRows(first, count, pixels);
+    });
+}
+
+FrameCapture::FrameCapture(const std::string& prefix, int workerCount, size_t bufferCount) : prefix(prefix) {
+    for (size_t i = 0; i < bufferCount; ++i) {
+        freeFrames.emplace_back(new Frame());
+    }
+    for (int i = 0; i < workerCount; ++i) {
+        workers.emplace_back(&FrameCapture::work, this);
+    }
+}
+
+// Writes every frame still queued before returning
+FrameCapture::~FrameCapture() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    frameQueued.notify_all();
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+    std::cout << "Captured " << frames << " frames to " << prefix << "_*.png: waited for a free buffer "
+        << stalls << " times, " << stallMs << " ms in all; at most " << peakQueued << " frames queued; "
+        << (frames > 0 ? encodeMs / frames : 0.0) << " ms to encode and write each\n";
+}
+
+// Reads the back buffer of the window, whose context must be active on this thread, before display().
+// Blocks while every buffer is queued or being written, so no frame is dropped.
+void FrameCapture::capture(const sf::RenderWindow& window) {
+    std::unique_ptr<Frame> frame;
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (freeFrames.empty()) {
+            sf::Clock stall;
+            bufferFreed.wait(lock, [this]() { return !freeFrames.empty(); });
+            ++stalls;
+            stallMs += stall.getElapsedTime().asMicroseconds() / 1000.0;
+        }
+        frame = std::move(freeFrames.back());
+        freeFrames.pop_back();
+    }
+
+    frame->width = window.getSize().x;
+    frame->height = window.getSize().y;
+    frame->pixels.resize(static_cast<size_t>(frame->width) * frame->height * 4);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, frame->width, frame->height, GL_RGBA, GL_UNSIGNED_BYTE, frame->pixels.data());
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        frame->index = frames++;
+        queued.push(std::move(frame));
+        peakQueued = std::max(peakQueued, queued.size());
+    }
+    frameQueued.notify_one();
+}
+
+void FrameCapture::work() {
+    while (true) {
+        std::unique_ptr<Frame> frame;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            frameQueued.wait(lock, [this]() { return stopping || !queued.empty(); });
+            if (queued.empty()) return;
+            frame = std::move(queued.front());
+            queued.pop();
+        }
+
+        // OpenGL rows run bottom to top
+        sf::Clock clock;
+        char name[32];
+        std::snprintf(name, sizeof(name), "_%06lu.png", frame->index);
+        const Frame& image = *frame;
+        bool written = writePng(prefix + name, image.width, image.height, [&image](int first, int count, uint32_t* pixels) {
+            for (int row = 0; row < count; ++row) {
+                const uint8_t* source = &image.pixels[static_cast<size_t>(image.height - 1 - (first + row)) * image.width * 4];
+                std::memcpy(pixels + static_cast<size_t>(row) * image.width, source, image.width * 4);
+            }
+        }, CAPTURE_MAX_CHAIN);
+        if (!written) {
+            std::cerr << "Error writing " << prefix << name << "\n";
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            encodeMs += clock.getElapsedTime().asMicroseconds() / 1000.0;
+            freeFrames.push_back(std::move(frame));
+        }
+        bufferFreed.notify_one();
+    }
+}
+
+Player::Player(int r, int c) : row(r), col(c), position(static_cast<float>(c), static_cast<float>(r)) {
+}
+
+void Player::move(int dx, int dy) {
+    row += dy;
+    col += dx;
+}
+
+// Jumps straight to a cell, without sliding there
+void Player::placeAt(int r, int c) {
+    row = r;
+    col = c;
+    position = sf::Vector2f(static_cast<float>(c), static_cast<float>(r));
+}
+
+// Slides position up to distance cells towards the player's cell; returns true on the step that arrives
+bool Player::step(float distance) {
+    if (!isMoving()) return false;
+    float dx = col - position.x;
+    float dy = row - position.y;
+    position.x += std::max(-distance, std::min(distance, dx));
+    position.y += std::max(-distance, std::min(distance, dy));
+    if (std::abs(col - position.x) < 1e-4f && std::abs(row - position.y) < 1e-4f) {
+        position = sf::Vector2f(static_cast<float>(col), static_cast<float>(row));
+    }
+    return !isMoving();
+}
+
+bool Player::isMoving() const {
+    return position.x != col || position.y != row;
+}
+
+// A disc a third of the shorter side of a cell in radius
+void Player::draw(SpriteLayer& sprites) const {
+    sprites.addRound(SPRITE_PLAYER, position + sf::Vector2f(0.5f, 0.5f), 1.0f / 3);
+}
+
+Menu::Menu(sf::Font& font) : font(font) {
+    sf::VideoMode desktop = sf::VideoMode::getDesktopMode();
+
+    float buttonWidth = desktop.width / 4;
+    float buttonHeight = desktop.height / 12;
     float buttonX = (desktop.width - buttonWidth) / 2;
     float startButtonY = desktop.height / 3 - buttonHeight / 2;
     float exitButtonY = desktop.height / 2 + buttonHeight / 2;
@@ -328,7 +3740,7 @@ Menu::Menu() {
 }
 
 void Menu::draw(sf::RenderWindow& window) {
-    window.draw(title);
+    countedDraw(window, title);
     startButton.draw(window);
     exitButton.draw(window);
 }
@@ -346,23 +3758,433 @@ int Menu::handleInput(sf::RenderWindow& window) {
     }
     return 0;
 }
-int main() {
+// Times single-direction against bidirectional BFS from the top-left cell to the exit on square mazes
+void benchmarkSolvers(const std::vector<int>& sizes) {
+    std::cout << "size\tbfs_us\tbfs_cells\tbidir_us\tbidir_cells\tpath\n";
+    for (int size : sizes) {
+        Maze maze(size, size);
+        maze.generate();
+        Solver solver(maze);
+        int exitIndex = maze.getIndex(size - 1, size - 1);
+
+        sf::Clock clock;
+        std::vector<int> path = solver.bfs(0, exitIndex);
+        sf::Int64 bfsTime = clock.restart().asMicroseconds();
+        size_t bfsExplored = solver.getExplored();
+
+        std::vector<int> bidirPath = solver.bidirectionalBfs(0, exitIndex);
+        sf::Int64 bidirTime = clock.restart().asMicroseconds();
+
+        std::cout << size << '\t' << bfsTime << '\t' << bfsExplored << '\t'
+            << bidirTime << '\t' << solver.getExplored() << '\t' << path.size();
+        if (bidirPath.size() != path.size()) {
+            std::cout << "\t(bidirectional path length " << bidirPath.size() << ")";
+        }
+        std::cout << '\n';
+    }
+}
+
+// Times the checkpoint tour planner on a square maze with randomly placed checkpoints
+void benchmarkTour(int size, int checkpointCount) {
+    Maze maze(size, size);
+    maze.generate();
+    std::vector<int> checkpoints;
+    for (int i = 0; i < checkpointCount; ++i) {
+        checkpoints.push_back(maze.getIndex(rand() % size, rand() % size));
+    }
+
+    TourPlanner planner(maze);
+    sf::Clock clock;
+    uint32_t length = planner.plan(0, checkpoints, maze.getExitIndex());
+    std::cout << size << "x" << size << ", " << checkpointCount << " checkpoints: tour of " << length
+        << " moves planned in " << clock.getElapsedTime().asMilliseconds() << " ms\n";
+}
+
+// Draws a maze and the player with each renderer in a WIDTH x HEIGHT window. Reports the first frame, which
+// builds the renderer's caches, and the average of the frames after it, with the draw counters of each.
+void benchmarkRender(int rows, int cols, int frames) {
+    sf::RenderWindow window(sf::VideoMode(WIDTH, HEIGHT), "Maze render benchmark");
+    const char* names[] = { "batched", "cached", "buffer", "shader" };
+    for (int mode = RENDER_BATCHED; mode <= RENDER_SHADER; ++mode) {
+        std::srand(1); // The same maze for every renderer
+        Maze maze(rows, cols);
+        maze.generate();
+        maze.setRenderMode(static_cast<MazeRenderMode>(mode));
+        Player player(0, 0);
+        SpriteLayer sprites;
+
+        auto drawFrame = [&]() {
+            window.clear();
+            window.setView(maze.getView(window, sf::Vector2f(), 1.0f));
+            maze.draw(window);
+            sprites.begin(window);
+            maze.drawMarkers(sprites);
+            player.draw(sprites);
+            sprites.draw(window);
+            window.setView(window.getDefaultView());
+            window.display();
+        };
+
+        drawCounters.reset();
+        sf::Clock clock;
+        drawFrame();
+        std::cout << names[mode] << ", " << rows << "x" << cols << ": first frame " << clock.getElapsedTime().asMicroseconds() / 1000.0
+            << " ms, " << drawCounters.describe() << "\n";
+
+        drawCounters.reset();
+        clock.restart();
+        for (int i = 0; i < frames; ++i) {
+            drawFrame();
+        }
+        DrawCounters perFrame = drawCounters;
+        perFrame.drawCalls /= frames;
+        perFrame.vertices /= frames;
+        perFrame.textureSwitches /= frames;
+        perFrame.shaderSwitches /= frames;
+        std::cout << names[mode] << ", " << rows << "x" << cols << ": " << clock.getElapsedTime().asMicroseconds() / 1000.0 / frames
+            << " ms per frame, " << perFrame.describe() << " per frame\n";
+    }
+}
+
+// Shows boardCount live mazes of rows x cols in one fullscreen window until Escape or close, ticking them at the
+// game's fixed rate. Reports the frame rate and the draw counters of an average frame when done.
+void runSpectatorGrid(int boardCount, int rows, int cols) {
+    sf::RenderWindow window(sf::VideoMode::getDesktopMode(), "Maze tournament", sf::Style::Fullscreen);
+    window.setVerticalSyncEnabled(true);
+    SpectatorGrid grid(boardCount, rows, cols);
+
+    sf::Clock clock;
+    sf::Time nextTick;
+    sf::Time tickTime;
+    double drawMs = 0;
+    unsigned long frames = 0;
+    drawCounters.reset();
+    while (window.isOpen()) {
+        sf::Event event;
+        while (window.pollEvent(event)) {
+            if (event.type == sf::Event::Closed
+                || (event.type == sf::Event::KeyPressed && event.key.code == sf::Keyboard::Escape)) {
+                window.close();
+            }
+        }
+        if (!window.isOpen()) break;
+
+        for (int ticks = 0; clock.getElapsedTime() >= nextTick; ++ticks) {
+            if (ticks == MAX_TICKS_PER_PASS) {
+                nextTick = clock.getElapsedTime();
+                break;
+            }
+            grid.tick();
+            tickTime = nextTick;
+            nextTick += sf::seconds(TICK_SECONDS);
+        }
+
+        sf::Clock drawClock;
+        window.clear();
+        float alpha = std::max(0.0f, std::min(1.0f, (clock.getElapsedTime() - tickTime).asSeconds() / TICK_SECONDS));
+        grid.draw(window, alpha);
+        drawMs += drawClock.getElapsedTime().asMicroseconds() / 1000.0;
+        window.display();
+        ++frames;
+    }
+
+    if (frames == 0) return;
+    DrawCounters perFrame = drawCounters;
+    perFrame.drawCalls /= frames;
+    perFrame.vertices /= frames;
+    perFrame.textureSwitches /= frames;
+    perFrame.shaderSwitches /= frames;
+    std::cout << boardCount << " boards of " << rows << "x" << cols << ": " << frames / clock.getElapsedTime().asSeconds()
+        << " fps, " << drawMs / frames << " ms drawing per frame, " << perFrame.describe() << " per frame\n";
+}
+
+// CPU time used by the process so far, in seconds
+double processCpuSeconds() {
+#ifdef _WIN32
+    FILETIME creation, exit, kernel, user;
+    GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user);
+    ULARGE_INTEGER kernelTime, userTime;
+    kernelTime.LowPart = kernel.dwLowDateTime;
+    kernelTime.HighPart = kernel.dwHighDateTime;
+    userTime.LowPart = user.dwLowDateTime;
+    userTime.HighPart = user.dwHighDateTime;
+    return (kernelTime.QuadPart + userTime.QuadPart) / 1e7;
+#else
+    return static_cast<double>(std::clock()) / CLOCKS_PER_SEC;
+#endif
+}
+
+// Counts what the main loop did, to compare event-driven against continuous redraw
+struct LoopStats {
+    sf::Clock wallClock;
+    double cpuAtStart = processCpuSeconds();
+    unsigned long frames = 0;
+    unsigned long wakeups = 0;
+
+    void report(bool eventDriven) {
+        double wall = wallClock.getElapsedTime().asSeconds();
+        double cpu = processCpuSeconds() - cpuAtStart;
+        std::cout << (eventDriven ? "Event-driven" : "Continuous") << " redraw: " << frames << " frames, "
+            << wakeups << " wake-ups, " << cpu << " s CPU over " << wall << " s ("
+            << (wall > 0 ? 100.0 * cpu / wall : 0.0) << "% of one core)\n";
+    }
+};
+
+// Checks a maze dump written by Maze::saveWalls without loading it into memory
+int validateDump(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    StreamSolver solver;
+    sf::Clock clock;
+    if (!in || !solver.solve(in)) {
+        std::cerr << "Error reading maze dump " << path << "\n";
+        return 1;
+    }
+    std::cout << solver.getRows() << "x" << solver.getCols() << ": ";
+    if (solver.isReachable()) {
+        std::cout << "exit reachable, shortest path " << solver.getPathLength() << " moves";
+    }
+    else {
+        std::cout << "exit NOT reachable";
+    }
+    std::cout << " (" << clock.getElapsedTime().asMilliseconds() << " ms, peak " << solver.getPeakNodes() << " graph nodes)\n";
+    return solver.isReachable() ? 0 : 2;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc > 1 && std::string(argv[1]) == "--bench-bfs") {
+        std::vector<int> sizes;
+        for (int i = 2; i < argc; ++i) {
+            sizes.push_back(std::atoi(argv[i]));
+        }
+        if (sizes.empty()) {
+            sizes = { 1024, 2048, 4096, 8192, 16384 };
+        }
+        benchmarkSolvers(sizes);
+        return 0;
+    }
+    if (argc > 4 && std::string(argv[1]) == "--dump-maze") {
+        Maze maze(std::atoi(argv[2]), std::atoi(argv[3]));
+        maze.generate();
+        std::ofstream out(argv[4], std::ios::binary);
+        maze.saveWalls(out);
+        return out ? 0 : 1;
+    }
+    if (argc > 2 && std::string(argv[1]) == "--render-image") {
+        // --render-image <file.png|file.ppm> [rows cols [pixels per cell]]. Under 2 pixels per cell, such as 0.25
+        // for a 16k maze, pixels average blocks of cells instead of drawing walls.
+        Maze maze(argc > 4 ? std::atoi(argv[3]) : ROWS, argc > 4 ? std::atoi(argv[4]) : COLS);
+        maze.generate();
+        double pixelsPerCell = argc > 5 ? std::atof(argv[5]) : 16;
+        SoftwareRasterizer rasterizer(maze, static_cast<int>(pixelsPerCell),
+            pixelsPerCell < 2 ? std::max(1, static_cast<int>(std::lround(1 / std::max(pixelsPerCell, 1e-6)))) : 0);
+        std::string path = argv[2];
+        bool ppm = path.size() > 4 && path.compare(path.size() - 4, 4, ".ppm") == 0;
+        if (!(ppm ? rasterizer.savePpm(path) : rasterizer.savePng(path))) {
+            std::cerr << "Error writing " << path << "\n";
+            return 1;
+        }
+        return 0;
+    }
+    if (argc > 2 && std::string(argv[1]) == "--validate") {
+        return validateDump(argv[2]);
+    }
+    if (argc > 1 && std::string(argv[1]) == "--bench-render") {
+        // --bench-render [rows cols [frames]]
+        benchmarkRender(argc > 3 ? std::atoi(argv[2]) : ROWS, argc > 3 ? std::atoi(argv[3]) : COLS, argc > 4 ? std::max(1, std::atoi(argv[4])) : 300);
+        return 0;
+    }
+    if (argc > 1 && std::string(argv[1]) == "--spectate") {
+        // --spectate [boards [rows cols]]
+        runSpectatorGrid(argc > 2 ? std::max(1, std::atoi(argv[2])) : 64, argc > 4 ? std::max(2, std::atoi(argv[3])) : ROWS,
+            argc > 4 ? std::max(2, std::atoi(argv[4])) : COLS);
+        return 0;
+    }
+    if (argc > 1 && std::string(argv[1]) == "--bench-tour") {
+        benchmarkTour(argc > 2 ? std::atoi(argv[2]) : 1024, argc > 3 ? std::atoi(argv[3]) : 20);
+        return 0;
+    }
+
+    // Game options
+    MazeRenderMode renderMode = RENDER_CACHED;
+    int mazeRows = ROWS;
+    int mazeCols = COLS;
+    bool forceScrolling = false;
+    bool eventDriven = true;
+    bool fogOfWar = false;
+    std::string capturePrefix;
+    for (int i = 1; i < argc; ++i) {
+        if (std::string(argv[i]) == "--camera") {
+            forceScrolling = true;
+        }
+        if (std::string(argv[i]) == "--continuous") {
+            eventDriven = false;
+        }
+        if (std::string(argv[i]) == "--fog") {
+            fogOfWar = true;
+        }
+        if (std::string(argv[i]) == "--capture" && i + 1 < argc) {
+            capturePrefix = argv[i + 1];
+        }
+        if (std::string(argv[i]) == "--size" && i + 2 < argc) {
+            mazeRows = std::max(2, std::atoi(argv[i + 1]));
+            mazeCols = std::max(2, std::atoi(argv[i + 2]));
+        }
+    }
+    for (int i = 1; i + 1 < argc; ++i) {
+        if (std::string(argv[i]) == "--renderer") {
+            std::string name = argv[i + 1];
+            if (name == "batched") renderMode = RENDER_BATCHED;
+            else if (name == "cached") renderMode = RENDER_CACHED;
+            else if (name == "buffer") renderMode = RENDER_BUFFER;
+            else if (name == "shader") renderMode = RENDER_SHADER;
+            else std::cerr << "Unknown renderer " << name << "\n";
+        }
+    }
+
     sf::VideoMode desktop = sf::VideoMode::getDesktopMode();
     sf::RenderWindow window(desktop, "Maze Game", sf::Style::Fullscreen);
-    window.setFramerateLimit(60);
+    window.setVerticalSyncEnabled(true);
 
-    Menu menu;
-    Maze maze;
+    Resources resources;
+    embedCompiledAssets(resources);
+    size_t mainFont = resources.loadFont("Arial.ttf");
+
+    Menu menu(resources.getFont(mainFont));
+    Maze maze(mazeRows, mazeCols);
     Player player(0, 0);
 
+    bool running = true;
     bool gameStarted = false;
     bool gameWon = false;
+    bool showHint = false;
+    bool showProfiler = false; // F3 shows the frame-time profiler and draw counters, F4 writes frame_times.csv
+    unsigned long csvRequests = 0;
 
-    while (window.isOpen()) {
+    sf::Vector2f fittedCellSize = maze.getFittedCellSize(window.getSize());
+    maze.setScrolling(forceScrolling || std::min(fittedCellSize.x, fittedCellSize.y) < MIN_CELL_SIZE);
+
+    // Zoom factor of the scrolling camera, changed with the mouse wheel or PageUp/PageDown; 1 is SCROLL_CELL_SIZE
+    // pixels per cell, larger values zoom out until the whole maze fits
+    float zoom = 1.0f;
+    const float maxZoom = std::max(1.0f, std::max(mazeCols * SCROLL_CELL_SIZE / window.getSize().x, mazeRows * SCROLL_CELL_SIZE / window.getSize().y));
+    auto zoomBy = [&](float factor) {
+        zoom = std::min(maxZoom, std::max(0.25f, zoom * factor));
+    };
+
+    // The question at the checkpoint the player is standing on, answered in place while the game goes on
+    bool questionActive = false;
+    int questionIndex = 0;
+    std::string answer;
+
+    // Rendering runs on its own thread, drawing from snapshots of the state below, so a slow display() or
+    // vsync wait never delays input. Unless --continuous is given it only draws after a snapshot is published.
+    GameRenderer renderer(window, resources.getFont(mainFont), mazeRows, mazeCols);
+    renderer.getMaze().setRenderMode(renderMode);
+    renderer.getMaze().setScrolling(maze.isScrolling());
+    if (!capturePrefix.empty()) {
+        // Encoding leaves a core each to the game and render threads; two buffers per worker keep them all busy
+        int workers = std::max(1, static_cast<int>(std::thread::hardware_concurrency()) - 2);
+        renderer.setCapture(std::unique_ptr<FrameCapture>(new FrameCapture(capturePrefix, workers, workers * 2)));
+    }
+    // Explored cells are tracked for the fog and for the minimap shown while the maze scrolls
+    std::shared_ptr<FogOfWar> fog;
+    if (fogOfWar || maze.isScrolling()) {
+        fog = std::make_shared<FogOfWar>(fogOfWar);
+        renderer.setFog(fog);
+    }
+    std::shared_ptr<const std::vector<uint8_t>> layout;
+    double eventMs = 0;
+    double updateMs = 0;
+
+    // Arrow keys queue a direction, taken by the first tick at which the player is standing in a cell
+    sf::Clock gameClock;
+    sf::Time nextTick;
+    sf::Time tickTime;
+    sf::Vector2f previousPosition = player.position;
+    int queuedDirection = -1;
+
+    auto tick = [&]() {
+        previousPosition = player.position;
+        if (!player.isMoving() && queuedDirection >= 0 && !questionActive) {
+            if (!maze.isWall(player.row, player.col, queuedDirection)) {
+                player.move(DIR_COL[queuedDirection], DIR_ROW[queuedDirection]);
+                if (fog) {
+                    fog->reveal(player.row, player.col);
+                }
+            }
+            queuedDirection = -1;
+        }
+        if (player.step(PLAYER_SPEED * TICK_SECONDS)) {
+            if (maze.isCheckpoint(player.row, player.col)) {
+                questionActive = true;
+                questionIndex = rand() % questions.size();
+                answer.clear();
+                queuedDirection = -1;
+            }
+
+            // Check if the player reached the exit
+            if (player.row == maze.getRows() - 1 && player.col == maze.getCols() - 1) {
+                gameWon = true;
+            }
+        }
+    };
+
+    auto publish = [&]() {
+        GameSnapshot snapshot;
+        snapshot.layout = layout;
+        for (const auto& pos : maze.getCheckpointPositions()) {
+            if (maze.isCheckpoint(pos.first, pos.second)) {
+                snapshot.checkpoints.push_back(maze.getIndex(pos.first, pos.second));
+            }
+        }
+        snapshot.playerRow = player.row;
+        snapshot.playerCol = player.col;
+        snapshot.previousPosition = previousPosition;
+        snapshot.position = player.position;
+        snapshot.tickTime = tickTime;
+        snapshot.gameStarted = gameStarted;
+        snapshot.gameWon = gameWon;
+        snapshot.showHint = showHint;
+        snapshot.showProfiler = showProfiler;
+        snapshot.zoom = zoom;
+        snapshot.questionActive = questionActive;
+        if (questionActive) {
+            snapshot.question = questions[questionIndex].getQuestion();
+            snapshot.answer = answer;
+        }
+        snapshot.csvRequests = csvRequests;
+        snapshot.eventMs = eventMs;
+        snapshot.updateMs = updateMs;
+        renderer.publish(std::move(snapshot));
+    };
+
+    LoopStats stats;
+    renderer.start(!eventDriven, gameClock);
+
+    // While nothing moves the game loop sleeps in waitEvent. Otherwise it wakes for each tick, handles the
+    // pending events, runs the ticks that are due and publishes.
+    while (running) {
         sf::Event event;
-        while (window.pollEvent(event)) {
+        bool haveEvent = false;
+        if (!player.isMoving() && queuedDirection < 0 && previousPosition == player.position) {
+            if (!window.waitEvent(event)) {
+                break;
+            }
+            ++stats.wakeups;
+            haveEvent = true;
+            nextTick = gameClock.getElapsedTime();
+        }
+        else if (nextTick > gameClock.getElapsedTime()) {
+            sf::sleep(nextTick - gameClock.getElapsedTime());
+        }
+
+        sf::Clock phaseClock;
+        while (haveEvent || window.pollEvent(event)) {
+            haveEvent = false;
+            eventMs += phaseClock.restart().asMicroseconds() / 1000.0;
+
             if (event.type == sf::Event::Closed) {
-                window.close();
+                running = false;
             }
 
             if (event.type == sf::Event::MouseButtonPressed && !gameStarted) {
@@ -370,142 +4192,108 @@ int main() {
                 if (menuResult == 1) {
                     gameStarted = true;
                     maze.generate();
+                    layout = std::make_shared<std::vector<uint8_t>>(maze.getLayout());
+                    if (fog) {
+                        fog->build(maze);
+                        fog->reveal(player.row, player.col);
+                    }
+
+                    std::vector<int> checkpoints;
+                    for (const auto& pos : maze.getCheckpointPositions()) {
+                        checkpoints.push_back(maze.getIndex(pos.first, pos.second));
+                    }
+                    TourPlanner planner(maze);
+                    uint32_t par = planner.plan(maze.getIndex(player.row, player.col), checkpoints, maze.getExitIndex());
+                    if (par != INFINITE_DISTANCE) {
+                        std::cout << "Par: " << par << " moves through every checkpoint to the exit\n";
+                    }
                 }
                 else if (menuResult == -1) {
-                    window.close();
+                    running = false;
                 }
             }
 
-            if (event.type == sf::Event::KeyPressed && gameStarted) {
-                if (event.key.code == sf::Keyboard::Up && !maze.isWall(player.row, player.col, 0)) {
-                    player.move(0, -1);
-                }
-                if (event.key.code == sf::Keyboard::Right && !maze.isWall(player.row, player.col, 1)) {
-                    player.move(1, 0);
-                }
-                if (event.key.code == sf::Keyboard::Down && !maze.isWall(player.row, player.col, 2)) {
-                    player.move(0, 1);
-                }
-                if (event.key.code == sf::Keyboard::Left && !maze.isWall(player.row, player.col, 3)) {
-                    player.move(-1, 0);
-                }
-
-                if (maze.isCheckpoint(player.row, player.col))
-                {
-                    int questionIndex = rand() % questions.size();
-                    std::string question = questions[questionIndex].getQuestion();
-                    std::string answer;
-                    bool answerEntered = false;
-
-                    sf::RectangleShape questionBox(sf::Vector2f(window.getSize().x, window.getSize().y));
-                    questionBox.setFillColor(sf::Color(0, 0, 0, 200)); // Semi-transparent black
-                    sf::Text questionText(question, menu.getFont(), 30);
-                    questionText.setFillColor(sf::Color::White);
-                    questionText.setPosition((window.getSize().x - questionText.getLocalBounds().width) / 2, (window.getSize().y - questionText.getLocalBounds().height) / 2);
-
-                    sf::Text answerText("", menu.getFont(), 30);
-                    answerText.setFillColor(sf::Color::White);
-                    answerText.setPosition((window.getSize().x - answerText.getLocalBounds().width) / 2, (window.getSize().y - answerText.getLocalBounds().height) / 2 + 50);
-
-
-                    while (window.isOpen() && !answerEntered) {
-                        sf::Event answerEvent;
-                        while (window.pollEvent(answerEvent)) {
-                            if (answerEvent.type == sf::Event::TextEntered) {
-                                if (answerEvent.text.unicode == 13) { // Enter key pressed
-                                    answerEntered = true;
-                                    break;
-                                }
-                                else if (answerEvent.text.unicode == 8) { // Backspace key pressed
-                                    if (!answer.empty()) {
-                                        answer.pop_back();
-                                    }
-                                }
-                                else if (answerEvent.text.unicode < 128) {
-                                    answer += static_cast<char>(answerEvent.text.unicode);
-                                }
-                                answerText.setString(answer);
-                            }
-                        }
-
-                        window.clear();
-                        maze.draw(window);
-                        player.draw(window);
-                        window.draw(questionBox);
-
-                        // Adjust font size dynamically based on window dimensions
-                        float fontSize = std::min(window.getSize().x / 40, window.getSize().y / 30); // Adjust divisor for different aspect ratios
-                        sf::Text questionText(question, menu.getFont(), static_cast<unsigned int>(fontSize));
-                        questionText.setFillColor(sf::Color::White);
-
-                        // Position the question text with space between left and right sides
-                        float padding = 20.0f; // Adjust as needed
-                        float maxTextWidth = window.getSize().x - 2 * padding; // Calculate maximum text width
-                        questionText.setPosition(padding, padding);
-                        questionText.setOrigin(0, 0);
-                        questionText.setScale(1.0f, 1.0f); // Reset scale before setting new scale
-                        if (questionText.getLocalBounds().width > maxTextWidth) {
-                            float scaleFactor = maxTextWidth / questionText.getLocalBounds().width;
-                            questionText.setScale(scaleFactor, scaleFactor);
-                        }
+            if (event.type == sf::Event::MouseWheelScrolled && gameStarted && maze.isScrolling()) {
+                zoomBy(event.mouseWheelScroll.delta > 0 ? 0.5f : 2.0f);
+            }
 
-                        window.draw(questionText);
-                        window.draw(answerText);
-                        window.display();
-                    }
+            if (event.type == sf::Event::KeyPressed && event.key.code == sf::Keyboard::F3) {
+                showProfiler = !showProfiler;
+            }
+            if (event.type == sf::Event::KeyPressed && event.key.code == sf::Keyboard::F4) {
+                ++csvRequests;
+            }
 
+            if (event.type == sf::Event::TextEntered && questionActive) {
+                if (event.text.unicode == 13) { // Enter key pressed
+                    questionActive = false;
                     if (questions[questionIndex].checkAnswer(answer)) {
                         maze.removeCheckpoint(player.row, player.col);
                         std::cout << "Correct!\n";
                     }
                     else {
                         std::cout << "Wrong! Try again later.\n";
-                        player.row = 0;
-                        player.col = 0;
+                        player.placeAt(0, 0);
+                        previousPosition = player.position;
                     }
                 }
-
-                // Check if the player reached the exit
-                if (player.row == ROWS - 1 && player.col == COLS - 1) {
-                    gameWon = true;
+                else if (event.text.unicode == 8) { // Backspace key pressed
+                    if (!answer.empty()) {
+                        answer.pop_back();
+                    }
+                }
+                else if (event.text.unicode < 128) {
+                    answer += static_cast<char>(event.text.unicode);
                 }
             }
-        }
 
-        window.clear();
-        if (!gameStarted) {
-            menu.draw(window);
-        }
-        else {
-            maze.draw(window);
-            player.draw(window);
-            if (gameWon) {
-                sf::Font font;
-                if (font.loadFromFile("arial.ttf")) {
-                    sf::Text congratulations("Congratulations! You won!", font, 50);
-
-                    // Adjust font size dynamically based on window dimensions
-                    float fontSize = window.getSize().x / 20; // Adjust divisor for different aspect ratios
-                    congratulations.setCharacterSize(static_cast<unsigned int>(fontSize));
-
-                    congratulations.setFillColor(sf::Color::Green);
+            if (event.type == sf::Event::KeyPressed && gameStarted && !questionActive) {
+                if (event.key.code == sf::Keyboard::PageUp && maze.isScrolling()) {
+                    zoomBy(0.5f);
+                }
+                if (event.key.code == sf::Keyboard::PageDown && maze.isScrolling()) {
+                    zoomBy(2.0f);
+                }
 
-                    // Center the text in the window
-                    sf::FloatRect textRect = congratulations.getLocalBounds();
-                    congratulations.setOrigin(textRect.left + textRect.width / 2.0f,
-                        textRect.top + textRect.height / 2.0f);
-                    congratulations.setPosition(window.getSize().x / 2.0f, window.getSize().y / 2.0f);
+                // Toggle the path-to-exit overlay
+                if (event.key.code == sf::Keyboard::H) {
+                    showHint = !showHint;
+                }
 
-                    window.draw(congratulations);
+                if (event.key.code == sf::Keyboard::Up) {
+                    queuedDirection = 0;
+                }
+                if (event.key.code == sf::Keyboard::Right) {
+                    queuedDirection = 1;
                 }
-                else {
-                    std::cerr << "Error loading font\n";
+                if (event.key.code == sf::Keyboard::Down) {
+                    queuedDirection = 2;
+                }
+                if (event.key.code == sf::Keyboard::Left) {
+                    queuedDirection = 3;
                 }
             }
+            updateMs += phaseClock.restart().asMicroseconds() / 1000.0;
         }
-        window.display();
-    }
+        eventMs += phaseClock.restart().asMicroseconds() / 1000.0;
 
+        // Run the ticks that are due
+        for (int ticks = 0; gameClock.getElapsedTime() >= nextTick; ++ticks) {
+            if (ticks == MAX_TICKS_PER_PASS) {
+                nextTick = gameClock.getElapsedTime();
+                break;
+            }
+            tick();
+            tickTime = nextTick;
+            nextTick += sf::seconds(TICK_SECONDS);
+        }
+        updateMs += phaseClock.restart().asMicroseconds() / 1000.0;
+        publish();
+    }
 
+    renderer.stop();
+    window.close();
+    stats.frames = renderer.getFrames();
+    stats.report(eventDriven);
     return 0;
 }
@@ -0,0 +1,2 @@
+// Identifiers of the assets embedded by main.rc
+#define IDR_ARIAL_FONT 101